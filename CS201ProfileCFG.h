@@ -0,0 +1,149 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * The numbering and hashing of the CFG of a function which the binary profiles are keyed by (see CS201ProfileFormat.h), shared by the pass which
+ * writes them and the passes which read them.
+ */
+
+#ifndef CS201_PROFILE_CFG_H
+#define CS201_PROFILE_CFG_H
+
+#include "CS201ProfileFormat.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/*
+ * The following function mixes the bytes bytes of value into a 64 bit FNV-1a hash, lowest byte first.
+ */
+inline void mixCS201Hash(uint64_t &hash, uint64_t value, int bytes) {
+  for(int i = 0; i < bytes; ++i) {
+    hash ^= (value >> (8 * i)) & 0xff;
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+/*
+ * The following function numbers the edges of a function like the binary profile: the distinct successors of every block in the order of the
+ * successor slots of its terminator, by source block, a block reached by several successor slots of a terminator being a single edge. The edges
+ * leaving block v start at firstEdge[v].
+ */
+template<typename Index>
+void collectCS201Edges(const std::vector<llvm::BasicBlock*> &blocks, const llvm::DenseMap<llvm::BasicBlock*, Index> &blockIds,
+    std::vector<std::pair<Index, Index>> &edges, std::vector<Index> &firstEdge) {
+
+  edges.clear();
+  firstEdge.clear();
+  for(Index v = 0; v < (Index) blocks.size(); ++v) {
+    firstEdge.push_back(edges.size());
+    llvm::TerminatorInst *TI = blocks[v]->getTerminator();
+    for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+      std::pair<Index, Index> edge(v, blockIds.lookup(TI->getSuccessor(s)));
+      if(std::find(edges.begin() + firstEdge[v], edges.end(), edge) == edges.end())
+        edges.push_back(edge);
+    }
+  }
+  firstEdge.push_back(edges.size());
+}
+
+/*
+ * The following function computes the checksum of the CFG of a function which is stored in the binary profile, a 64 bit FNV-1a hash of the number of
+ * blocks and of the end points of every edge (see collectCS201Edges).
+ */
+template<typename Index>
+uint64_t computeCS201CFGChecksum(uint32_t numBlocks, const std::vector<std::pair<Index, Index>> &edges) {
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  mixCS201Hash(hash, numBlocks, 4);
+  for(auto &edge: edges) {
+    mixCS201Hash(hash, (uint32_t) edge.first, 4);
+    mixCS201Hash(hash, (uint32_t) edge.second, 4);
+  }
+  return hash;
+}
+
+/*
+ * The following function computes the identities of the blocks of a function which are stored in the binary profile, so that a profile can be
+ * mapped to the function after it changed (see CS201BlockRecord), and returns the structural hash of the function. The hash of a block is a 64 bit
+ * FNV-1a hash of the opcodes of its instructions, with the predicates of the comparisons and the names of the called functions, and of its number
+ * of successors. Its line is the one of its first instruction with a debug location, counted from the first line of the function so that the
+ * changes above the function leave it alone. The structural hash combines the hash of every block with the
+ * ones of its successors (edges, see collectCS201Edges), in an order which does not depend on the order of the blocks.
+ */
+template<typename Index>
+uint64_t computeCS201BlockHashes(const std::vector<llvm::BasicBlock*> &blocks, const std::vector<std::pair<Index, Index>> &edges,
+    std::vector<CS201BlockRecord> &records) {
+
+  auto getLine = [](const llvm::Instruction &I) -> uint32_t {
+    llvm::DebugLoc location = I.getDebugLoc();
+    if(location.isUnknown())
+      return 0;
+    return location.getLine();
+  };
+
+  uint32_t firstLine = UINT32_MAX;
+  for(auto BB: blocks) {
+    for(auto &I: *BB) {
+      if(getLine(I) > 0)
+        firstLine = std::min(firstLine, getLine(I));
+    }
+  }
+  records.clear();
+  for(auto BB: blocks) {
+    CS201BlockRecord record = {0xcbf29ce484222325ULL, 0, 0};
+    for(auto &I: *BB) {
+      if(llvm::isa<llvm::DbgInfoIntrinsic>(&I))
+        continue;
+      mixCS201Hash(record.hash, I.getOpcode(), 4);
+      if(llvm::CmpInst *cmp = llvm::dyn_cast<llvm::CmpInst>(&I))
+        mixCS201Hash(record.hash, cmp->getPredicate(), 4);
+      llvm::CallSite CS(&I);
+      if(CS) {
+        if(llvm::Function *callee = llvm::dyn_cast<llvm::Function>(CS.getCalledValue()->stripPointerCasts())) {
+          for(char c: callee->getName())
+            mixCS201Hash(record.hash, (unsigned char) c, 1);
+        }
+      }
+      if(record.line == 0 && getLine(I) > 0)
+        record.line = getLine(I) - firstLine + 1;
+    }
+    mixCS201Hash(record.hash, BB->getTerminator()->getNumSuccessors(), 4);
+    records.push_back(record);
+  }
+
+  // Every block with the sorted hashes of its successors, the entry block first and the other blocks in the order of their hashes.
+  std::vector<std::vector<uint64_t>> successors(blocks.size());
+  for(auto &edge: edges)
+    successors[edge.first].push_back(records[edge.second].hash);
+  std::vector<uint64_t> blockHashes;
+  for(size_t v = 0; v < blocks.size(); ++v) {
+    std::sort(successors[v].begin(), successors[v].end());
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    mixCS201Hash(hash, records[v].hash, 8);
+    for(auto successor: successors[v])
+      mixCS201Hash(hash, successor, 8);
+    blockHashes.push_back(hash);
+  }
+  if(!blockHashes.empty())
+    std::sort(blockHashes.begin() + 1, blockHashes.end());
+  uint64_t structuralHash = 0xcbf29ce484222325ULL;
+  mixCS201Hash(structuralHash, blocks.size(), 4);
+  for(auto hash: blockHashes)
+    mixCS201Hash(structuralHash, hash, 8);
+  return structuralHash;
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * Layout of the binary profile files written by the programs instrumented with the CS201Profiling pass.
+ * The integers are stored in the byte order of the profiled program, and every record starts at a multiple of 8 bytes.
+ *
+ *   CS201ProfileHeader
+ *   numFunctions times:
+ *     CS201FunctionRecord
+ *     name of the function (nameLength bytes, not terminated)
+ *     numEdges times CS201EdgeRecord
+ *     padding up to a multiple of 8 bytes
+ *     numBlocks times CS201BlockRecord, by block id
+ *   numCounts 64 bit counts: for every function in the above order, numBlocks block counts (by block id),
+ *   numEdges edge counts (in the order of the edge records) and numPaths path counts (by path number).
+ *
+ * Everything up to the counts (the descriptors) only depends on the instrumented program. When a program finds a profile file it adds the counts
+ * of the file to its own, function by function: the functions are matched by name and checksum, the functions of the file which the program does
+ * not have are kept, and the ones whose CFG changed are dropped.
+ *
+ * The blocks are numbered in the order of the function, so any change of a function renumbers them. The block records and the structural hash of a
+ * function identify its blocks independently of their numbers, so that the counts of a profile can be mapped to a function which changed since
+ * (see matchCS201Blocks in CS201ProfileReader.h).
+ */
+
+#ifndef CS201_PROFILE_FORMAT_H
+#define CS201_PROFILE_FORMAT_H
+
+#include <stdint.h>
+
+// "CS201PRF" read as a little endian integer.
+#define CS201_PROFILE_MAGIC 0x4652503130325343ULL
+#define CS201_PROFILE_VERSION 2
+
+// The environment variable which names the profile file. Every "%p" in it is replaced by the process id.
+#define CS201_PROFILE_FILE_ENV "CS201_PROFILE_FILE"
+#define CS201_PROFILE_FILE_DEFAULT "cs201.prof"
+
+struct CS201ProfileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t numFunctions;
+  uint64_t numCounts;
+};
+
+struct CS201FunctionRecord {
+  // A hash of the number of blocks and of the edges of the function, see computeCS201CFGChecksum in CS201ProfileCFG.h.
+  uint64_t checksum;
+  // A hash of the blocks and edges of the function which does not depend on the order of the blocks, see computeCS201BlockHashes.
+  uint64_t structuralHash;
+  uint32_t nameLength;
+  uint32_t numBlocks;
+  uint32_t numEdges;
+  // The number of paths of the function if it has one counter per path, and zero otherwise.
+  uint32_t numPaths;
+};
+
+// An edge between two blocks, identified by their position in the function.
+struct CS201EdgeRecord {
+  uint32_t src;
+  uint32_t dst;
+};
+
+// The identity of a block: a hash of its instructions and number of successors, and the line of its first instruction with a debug location,
+// counted from the first line of the function (1 being the first line, and 0 meaning no debug location).
+struct CS201BlockRecord {
+  uint64_t hash;
+  uint32_t line;
+  uint32_t reserved;
+};
+
+/*
+ * Layout of the coverage files written by the programs instrumented with -coverage. It is the layout of the profile files with its own magic,
+ * numCounts being the number of bits of the coverage bitmap which follows the descriptors instead of the counts, and the functions having no
+ * paths. For every function in the order of the records the bitmap has numBlocks bits (by block id) and numEdges bits (in the order of the
+ * edge records), bit i being bit i % 8 of byte i / 8, and it is padded with zero bits to a multiple of 8 bytes. A coverage file is merged
+ * like a profile file, the coverage of a function being added to the one of the file.
+ */
+
+// "CS201COV" read as a little endian integer.
+#define CS201_COVERAGE_MAGIC 0x564f433130325343ULL
+#define CS201_COVERAGE_VERSION 2
+
+// The environment variable which names the coverage file. Every "%p" in it is replaced by the process id.
+#define CS201_COVERAGE_FILE_ENV "CS201_COVERAGE_FILE"
+#define CS201_COVERAGE_FILE_DEFAULT "cs201.cov"
+
+/*
+ * Layout of the live counters file of a program whose modules were instrumented with -mmap-counters. The counters of every such module are
+ * mapped from the file, so that another process can read (and clear) them while the program runs.
+ *
+ *   CS201CountersHeader, padded to pageSize bytes
+ *   numModules times:
+ *     CS201CountersModule
+ *     name of the module (nameLength bytes), padded to a multiple of 8 bytes
+ *     numFunctions times:
+ *       CS201CountersFunction
+ *       name of the function (nameLength bytes), padded to a multiple of 8 bytes
+ *       numEdges times CS201EdgeRecord
+ *       numBlocks + numEdges + 1 uint32_t: the count of block v is made of the terms [termStart[v], termStart[v + 1]) and the count of edge e
+ *         of the terms [termStart[numBlocks + e], termStart[numBlocks + e + 1]), padded to a multiple of 8 bytes
+ *       termStart[numBlocks + numEdges] times CS201CountersTerm
+ *     padding up to countersOffset, a multiple of pageSize
+ *     the counters of the module (countersSize bytes, a multiple of pageSize), the next module starting after them
+ *
+ * The header is written first and numModules is increased once a module is complete, so a reader only looks at the first numModules modules.
+ */
+
+// "CS201CNT" read as a little endian integer.
+#define CS201_COUNTERS_MAGIC 0x544e433130325343ULL
+#define CS201_COUNTERS_VERSION 2
+
+// The environment variable which names the live counters file. Every "%p" in it is replaced by the process id.
+#define CS201_COUNTERS_FILE_ENV "CS201_COUNTERS_FILE"
+#define CS201_COUNTERS_FILE_DEFAULT "cs201-%p.counters"
+
+struct CS201CountersHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t pageSize;
+  uint64_t pid;
+  uint32_t numModules;
+  uint32_t reserved;
+};
+
+struct CS201CountersModule {
+  uint64_t countersOffset;
+  uint64_t countersSize;
+  uint32_t numFunctions;
+  uint32_t nameLength;
+  // The size in bytes of one counter.
+  uint32_t counterSize;
+  uint32_t reserved;
+};
+
+struct CS201CountersFunction {
+  uint64_t checksum;
+  uint32_t nameLength;
+  uint32_t numBlocks;
+  uint32_t numEdges;
+  uint32_t numPaths;
+  // The file offset of the dense path counters.
+  uint64_t pathsOffset;
+  // The number the counters are multiplied by to get the counts: the sampling interval of a sampled function, and 1 otherwise.
+  uint32_t scale;
+  uint32_t reserved;
+};
+
+// A term of a count: coefficient times the counter at the given file offset.
+struct CS201CountersTerm {
+  uint64_t offset;
+  int64_t coefficient;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * Reader of the binary profile files (see CS201ProfileFormat.h), shared by the passes and tools which read them.
+ */
+
+#ifndef CS201_PROFILE_READER_H
+#define CS201_PROFILE_READER_H
+
+#include "CS201ProfileFormat.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The counts of a function read from a binary profile.
+struct CS201FunctionProfile {
+  std::string name;
+  uint64_t checksum;
+  uint64_t structuralHash;
+  uint32_t numBlocks;
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  // The identities of the blocks, by block id.
+  std::vector<CS201BlockRecord> blocks;
+  std::vector<uint64_t> blockCounts;
+  std::vector<uint64_t> edgeCounts;
+  // The counts of the paths, by path number, if the function has one counter per path.
+  std::vector<uint64_t> pathCounts;
+};
+
+/*
+ * The following function reads the function records and counts of a binary profile, in the order of the file. Returns false if the profile is
+ * malformed.
+ */
+inline bool readCS201Profile(const char *data, size_t size, std::vector<CS201FunctionProfile> &functions) {
+
+  CS201ProfileHeader header;
+  if(size < sizeof(header))
+    return false;
+  memcpy(&header, data, sizeof(header));
+  if(header.magic != CS201_PROFILE_MAGIC || header.version != CS201_PROFILE_VERSION)
+    return false;
+
+  size_t position = sizeof(header);
+  std::vector<CS201FunctionProfile> records;
+  std::vector<uint32_t> numPaths;
+  // The counts of the records read so far, which can be neither more than the header says nor more than the rest of the file holds.
+  uint64_t totalCounts = 0;
+  for(uint32_t f = 0; f < header.numFunctions; ++f) {
+    CS201FunctionRecord record;
+    if(position + sizeof(record) > size)
+      return false;
+    memcpy(&record, data + position, sizeof(record));
+    position += sizeof(record);
+    totalCounts += (uint64_t) record.numBlocks + record.numEdges + record.numPaths;
+    if(totalCounts > header.numCounts || totalCounts > (size - position) / sizeof(uint64_t))
+      return false;
+    size_t recordSize = record.nameLength + (size_t) record.numEdges * sizeof(CS201EdgeRecord);
+    if(position + recordSize > size)
+      return false;
+    CS201FunctionProfile profile;
+    profile.name.assign(data + position, record.nameLength);
+    profile.checksum = record.checksum;
+    profile.structuralHash = record.structuralHash;
+    profile.numBlocks = record.numBlocks;
+    for(uint32_t e = 0; e < record.numEdges; ++e) {
+      CS201EdgeRecord edge;
+      memcpy(&edge, data + position + record.nameLength + e * sizeof(edge), sizeof(edge));
+      profile.edges.push_back(std::make_pair(edge.src, edge.dst));
+    }
+    position += recordSize + (8 - record.nameLength % 8) % 8;
+    if(position + (size_t) record.numBlocks * sizeof(CS201BlockRecord) > size)
+      return false;
+    profile.blocks.resize(record.numBlocks);
+    if(record.numBlocks > 0)
+      memcpy(&profile.blocks[0], data + position, record.numBlocks * sizeof(CS201BlockRecord));
+    position += record.numBlocks * sizeof(CS201BlockRecord);
+    records.push_back(profile);
+    numPaths.push_back(record.numPaths);
+  }
+
+  if(header.numCounts > (size - position) / sizeof(uint64_t))
+    return false;
+  const char *counts = data + position;
+  uint64_t next = 0;
+  auto readCount = [&]() {
+    uint64_t count = 0;
+    if(next < header.numCounts)
+      memcpy(&count, counts + next * sizeof(uint64_t), sizeof(uint64_t));
+    next++;
+    return count;
+  };
+  for(size_t f = 0; f < records.size(); ++f) {
+    CS201FunctionProfile &profile = records[f];
+    for(uint32_t b = 0; b < profile.numBlocks; ++b)
+      profile.blockCounts.push_back(readCount());
+    for(uint32_t e = 0; e < profile.edges.size(); ++e)
+      profile.edgeCounts.push_back(readCount());
+    for(uint32_t p = 0; p < numPaths[f]; ++p)
+      profile.pathCounts.push_back(readCount());
+  }
+  if(next != header.numCounts)
+    return false;
+  functions.insert(functions.end(), records.begin(), records.end());
+  return true;
+}
+
+/*
+ * The following function returns the entry count above which a function is hot: percent percents of the largest entry count of a profile, and at
+ * least 1. The remainder is scaled apart so that the count neither truncates to a multiple of 100 nor overflows.
+ */
+inline uint64_t getCS201HotEntryCount(uint64_t maxEntryCount, unsigned percent) {
+  return std::max((uint64_t) 1, maxEntryCount / 100 * percent + maxEntryCount % 100 * percent / 100);
+}
+
+/*
+ * The following function maps the blocks of a function to the blocks of a profile taken before the function changed, by their identities (see
+ * CS201BlockRecord). The entry blocks are always matched. Every other block is matched with a block of the profile with the same hash: the only one
+ * if there is one on both sides, and otherwise the one with the nearest line and then the nearest position. Returns the profile block of every
+ * block, or -1 for the blocks which have no match.
+ */
+inline std::vector<int> matchCS201Blocks(const std::vector<CS201BlockRecord> &blocks, const std::vector<CS201BlockRecord> &profileBlocks) {
+
+  std::vector<int> match(blocks.size(), -1);
+  if(blocks.empty() || profileBlocks.empty())
+    return match;
+  match[0] = 0;
+
+  // The blocks of both sides by hash, the entry blocks excepted.
+  std::map<uint64_t, std::pair<std::vector<uint32_t>, std::vector<uint32_t>>> byHash;
+  for(uint32_t b = 1; b < blocks.size(); ++b)
+    byHash[blocks[b].hash].first.push_back(b);
+  for(uint32_t b = 1; b < profileBlocks.size(); ++b) {
+    auto it = byHash.find(profileBlocks[b].hash);
+    if(it != byHash.end())
+      it->second.second.push_back(b);
+  }
+
+  std::vector<bool> taken(profileBlocks.size(), false);
+  for(auto &group : byHash) {
+    const std::vector<uint32_t> &ours = group.second.first, &theirs = group.second.second;
+    if(theirs.empty())
+      continue;
+    // The pairs of blocks by distance: lines first (when both blocks have one), then positions. Large groups are matched in order instead.
+    if(ours.size() * theirs.size() > 4096) {
+      for(size_t i = 0; i < std::min(ours.size(), theirs.size()); ++i)
+        match[ours[i]] = theirs[i];
+      continue;
+    }
+    std::vector<std::pair<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, uint32_t>>> pairs;
+    for(uint32_t a : ours) {
+      for(uint32_t b : theirs) {
+        uint32_t lineA = blocks[a].line, lineB = profileBlocks[b].line;
+        uint32_t lineDistance = lineA == 0 || lineB == 0 ? 0 : (lineA > lineB ? lineA - lineB : lineB - lineA);
+        pairs.push_back(std::make_pair(std::make_pair(lineDistance, a > b ? a - b : b - a), std::make_pair(a, b)));
+      }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    for(auto &pair : pairs) {
+      uint32_t a = pair.second.first, b = pair.second.second;
+      if(match[a] < 0 && !taken[b]) {
+        match[a] = b;
+        taken[b] = true;
+      }
+    }
+  }
+  return match;
+}
+
+#endif
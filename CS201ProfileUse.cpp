@@ -0,0 +1,584 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+#include "CS201ProfileCFG.h"
+#include "CS201ProfileReader.h"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <set>
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * The binary profile read by the profile use and layout passes, written by the programs instrumented with the CS201Profiling pass (see CS201ProfileFormat.h).
+ */
+static cl::opt<string> ProfileFile("cs201-profile-file",
+    cl::desc("Binary profile used by -cs201-profile-use and -cs201-layout"), cl::value_desc("file"), cl::init(CS201_PROFILE_FILE_DEFAULT));
+
+/*
+ * Functions whose entry count is at least this percentage of the largest entry count of the profile are marked as hot (inlinehint).
+ */
+static cl::opt<unsigned> HotEntryPercent("cs201-hot-entry-percent",
+    cl::desc("Entry count, in percent of the largest one, above which a function is hot"), cl::init(1));
+
+/*
+ * A function whose CFG changed since it was profiled is annotated from the blocks which can be matched with the ones of the profile, if at least this
+ * percentage of its blocks are matched.
+ */
+static cl::opt<unsigned> StaleMatchPercent("cs201-stale-match-percent",
+    cl::desc("Percentage of the blocks of a changed function which must match the profile for it to be used"), cl::init(50));
+
+/*
+ * The blocks which ran at most this many times in a function which ran are cold, and moved to functions of their own by -cs201-layout if they make
+ * a region of at least -cs201-cold-min-instructions instructions.
+ */
+static cl::opt<bool> SplitColdBlocks("cs201-split-cold", cl::desc("Move the cold blocks of the functions to functions of their own"), cl::init(true));
+static cl::opt<unsigned> ColdCount("cs201-cold-count", cl::desc("Execution count up to which a block is cold"), cl::init(0));
+static cl::opt<unsigned> ColdMinInstructions("cs201-cold-min-instructions",
+    cl::desc("Smallest number of instructions of a cold region moved to a function of its own"), cl::init(8));
+
+/*
+ * The section of the functions which never ran and of the cold regions moved out of their function, which the linker keeps away from the hot code.
+ */
+static cl::opt<string> ColdSection("cs201-cold-section", cl::desc("Section of the cold code (none if empty)"), cl::init(".text.unlikely"));
+
+/*
+ * The largest number of instructions of a cluster of functions which call each other and are laid out together.
+ */
+static cl::opt<unsigned> ClusterSize("cs201-cluster-size", cl::desc("Largest number of instructions of a cluster of functions"), cl::init(4096));
+
+namespace {
+
+  // A function with its blocks and edges numbered like the instrumentation does, and their counts mapped from the profile, the blocks and edges
+  // which the profile does not have counting -1.
+  struct ProfiledFunction {
+    vector<BasicBlock*> blocks;
+    DenseMap<BasicBlock*, uint32_t> blockIds;
+    vector<pair<uint32_t, uint32_t>> edges;
+    // The edges leaving block v start at firstEdge[v].
+    vector<uint32_t> firstEdge;
+    vector<int64_t> blockCounts;
+    vector<int64_t> edgeCounts;
+    uint64_t entryCount = 0;
+  };
+
+  /*
+   * The following function reads the binary profile, by function name. Static functions of different modules can have the same name. Returns false
+   * if there is no valid profile.
+   */
+  bool readProfile(multimap<string, CS201FunctionProfile> &profiles) {
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(ProfileFile);
+    if(!buffer) {
+      errs() << "Warning: cannot read the profile " << ProfileFile << ": " << buffer.getError().message() << "\n";
+      return false;
+    }
+    vector<CS201FunctionProfile> records;
+    if(!readCS201Profile((*buffer)->getBufferStart(), (*buffer)->getBufferSize(), records)) {
+      errs() << "Warning: " << ProfileFile << " is not a valid CS201 profile\n";
+      return false;
+    }
+    for(auto &record: records)
+      profiles.insert(make_pair(record.name, record));
+    return true;
+  }
+
+  /*
+   * The following function finds the profile of a function and maps its counts to the blocks and edges of the function. A function is matched by
+   * name and by the checksum of its CFG, which is numbered exactly as by the instrumentation: the blocks in the order of the function and the
+   * edges by collectCS201Edges. When the CFG changed since the function was profiled, its blocks are matched with the ones of the profile
+   * by their hashes and lines (see matchCS201Blocks), and only the matched blocks and edges get counts. Returns false if the function is not in the
+   * profile or too few of its blocks match (-cs201-stale-match-percent), the warnings telling what is not done (use) with the function.
+   */
+  bool matchProfile(Function &F, multimap<string, CS201FunctionProfile> &profiles, ProfiledFunction &function, const char *use) {
+
+    auto range = profiles.equal_range(F.getName().str());
+    if(range.first == range.second)
+      return false;
+
+    vector<BasicBlock*> &blocks = function.blocks;
+    vector<pair<uint32_t, uint32_t>> &edges = function.edges;
+    vector<uint32_t> &firstEdge = function.firstEdge;
+    for(auto &BB: F) {
+      function.blockIds[&BB] = blocks.size();
+      blocks.push_back(&BB);
+    }
+    collectCS201Edges(blocks, function.blockIds, edges, firstEdge);
+
+    uint64_t checksum = computeCS201CFGChecksum(blocks.size(), edges);
+    for(auto it = range.first; it != range.second; ++it) {
+      CS201FunctionProfile &profile = it->second;
+      if(profile.checksum == checksum && profile.edges == edges) {
+        function.blockCounts.assign(profile.blockCounts.begin(), profile.blockCounts.end());
+        function.edgeCounts.assign(profile.edgeCounts.begin(), profile.edgeCounts.end());
+        function.entryCount = profile.blockCounts.empty() ? 0 : profile.blockCounts[0];
+        return true;
+      }
+    }
+
+    // The blocks are matched with the ones of the profile of this name which has the most matching blocks.
+    vector<CS201BlockRecord> blockRecords;
+    uint64_t structuralHash = computeCS201BlockHashes(blocks, edges, blockRecords);
+    CS201FunctionProfile *match = NULL;
+    vector<int> mapping;
+    unsigned numMatched = 0;
+    for(auto it = range.first; it != range.second; ++it) {
+      vector<int> blockMatch = matchCS201Blocks(blockRecords, it->second.blocks);
+      unsigned n = blocks.size() - count(blockMatch.begin(), blockMatch.end(), -1);
+      if(n > numMatched) {
+        match = &it->second;
+        mapping.swap(blockMatch);
+        numMatched = n;
+      }
+    }
+    if(!match || numMatched * 100 < blocks.size() * StaleMatchPercent) {
+      errs() << "Warning: the CFG of function " << F.getName() << " does not match the profile, it is not " << use << "\n";
+      return false;
+    }
+    // A function whose blocks only moved has the same structural hash, and every block and edge is matched.
+    if(match->structuralHash != structuralHash)
+      errs() << "Warning: the CFG of function " << F.getName() << " changed since it was profiled, it is " << use << " from " << numMatched
+             << " of its " << blocks.size() << " blocks\n";
+
+    function.blockCounts.assign(blocks.size(), -1);
+    for(uint32_t v = 0; v < blocks.size(); ++v) {
+      if(mapping[v] >= 0)
+        function.blockCounts[v] = match->blockCounts[mapping[v]];
+    }
+    map<pair<uint32_t, uint32_t>, uint64_t> profileEdges;
+    for(uint32_t e = 0; e < match->edges.size(); ++e)
+      profileEdges[match->edges[e]] = match->edgeCounts[e];
+    function.edgeCounts.assign(edges.size(), -1);
+    for(uint32_t e = 0; e < edges.size(); ++e) {
+      int src = mapping[edges[e].first], dst = mapping[edges[e].second];
+      if(src < 0 || dst < 0)
+        continue;
+      auto it = profileEdges.find(make_pair((uint32_t) src, (uint32_t) dst));
+      if(it != profileEdges.end())
+        function.edgeCounts[e] = it->second;
+    }
+    function.entryCount = match->blockCounts.empty() ? 0 : match->blockCounts[0];
+    return true;
+  }
+
+  /*
+   * The following subclass extends the function pass to feed a binary profile back into the program being compiled, so that the optimizations
+   * which follow it use the measured frequencies:
+   * 1. Every conditional branch and switch gets branch_weights profile metadata with the counts of its outgoing edges. A block reached by several
+   *    successor slots of a terminator is a single edge of the profile, so its count is divided among these slots.
+   * 2. Functions which were never entered are marked as cold, and the functions entered at least -cs201-hot-entry-percent percent as often as the
+   *    most frequently entered one get the inlinehint attribute. LLVM 3.6 has no function entry count, so these attributes stand for it.
+   * The functions are matched with the profile by matchProfile. When the CFG of a function changed since it was profiled, only the branches whose
+   * edges all have a count are annotated.
+   */
+  struct CS201ProfileUse : public FunctionPass {
+
+    static char ID;
+    // Stores the profile of every function, by name.
+    multimap<string, CS201FunctionProfile> profiles;
+    // Stores the entry count above which a function is hot.
+    uint64_t hotEntryCount = 0;
+
+    CS201ProfileUse() : FunctionPass(ID) {}
+
+    /*
+     * The doInitialization method reads the binary profile.
+     */
+    bool doInitialization(Module &M) override {
+
+      if(HotEntryPercent > 100) {
+        errs() << "Warning: -cs201-hot-entry-percent=" << HotEntryPercent << " is above 100, 100 is used\n";
+        HotEntryPercent = 100;
+      }
+      profiles.clear();
+      readProfile(profiles);
+      uint64_t maxEntryCount = 0;
+      for(auto &profile: profiles) {
+        if(!profile.second.blockCounts.empty())
+          maxEntryCount = max(maxEntryCount, profile.second.blockCounts[0]);
+      }
+      hotEntryCount = getCS201HotEntryCount(maxEntryCount, HotEntryPercent);
+      return false;
+    }
+
+    /*
+     * The runOnFunction method attaches the counts of the profile to a function.
+     */
+    bool runOnFunction(Function &F) override {
+
+      ProfiledFunction function;
+      if(!matchProfile(F, profiles, function, "annotated"))
+        return false;
+      vector<BasicBlock*> &blocks = function.blocks;
+
+      if(function.entryCount == 0)
+        F.addFnAttr(Attribute::Cold);
+      else if(function.entryCount >= hotEntryCount && !F.hasFnAttribute(Attribute::NoInline))
+        F.addFnAttr(Attribute::InlineHint);
+
+      MDBuilder builder(F.getContext());
+      for(uint32_t v = 0; v < blocks.size(); ++v) {
+        TerminatorInst *TI = blocks[v]->getTerminator();
+        if(TI->getNumSuccessors() < 2 || !(isa<BranchInst>(TI) || isa<SwitchInst>(TI)))
+          continue;
+
+        // The count of every successor slot, the count of an edge being split evenly among the slots which lead to its destination. A branch
+        // with an edge which has no count is left alone.
+        vector<uint64_t> slotCounts;
+        bool complete = true;
+        for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+          BasicBlock *succ = TI->getSuccessor(s);
+          unsigned numSlots = 0;
+          for(unsigned t = 0; t != e; ++t)
+            numSlots += TI->getSuccessor(t) == succ;
+          uint32_t w = function.blockIds[succ];
+          int64_t count = -1;
+          for(uint32_t edge = function.firstEdge[v]; edge < function.firstEdge[v + 1]; ++edge) {
+            if(function.edges[edge].second == w)
+              count = function.edgeCounts[edge];
+          }
+          complete &= count >= 0;
+          slotCounts.push_back(count / numSlots);
+        }
+        if(!complete)
+          continue;
+
+        // The weights are 32 bit, so large counts are scaled down. A weight of zero would make the branch look impossible, so one is added.
+        uint64_t maxCount = *max_element(slotCounts.begin(), slotCounts.end());
+        uint64_t scale = maxCount / UINT32_MAX + 1;
+        vector<uint32_t> weights;
+        for(auto count: slotCounts)
+          weights.push_back(count / scale + 1);
+        TI->setMetadata(LLVMContext::MD_prof, builder.createBranchWeights(weights));
+      }
+      return true;
+    }
+  };
+
+  /*
+   * The following subclass extends the module pass to lay out the code of the program from a binary profile, so that the hot code takes fewer
+   * instruction cache lines and pages and runs fewer taken branches:
+   * 1. The blocks of every profiled function are chained along their hottest edges (Pettis and Hansen): the edges are visited by decreasing count,
+   *    and an edge joins the chain which ends at its source with the chain which starts at its destination. The chain of the entry block comes
+   *    first, then the chain with the most executed edges to the chains placed so far (the hottest one if there is none), the chains which never
+   *    ran coming last in their order (see layoutBlocks).
+   * 2. The cold regions of the functions which ran, a block which ran at most -cs201-cold-count times with all the blocks it dominates, are moved
+   *    to cold noinline functions of their own by the code extractor (see splitColdRegions).
+   * 3. The functions are ordered by hotness and call affinity: by decreasing number of block executions, every function is appended to the
+   *    cluster of its most frequent caller as long as the cluster has at most -cs201-cluster-size instructions, and the clusters are ordered by
+   *    decreasing block executions per instruction. The functions which were not profiled follow in their order, then the functions which never ran
+   *    and the cold regions, which are put in the -cs201-cold-section section (see orderFunctions).
+   * The functions are matched with the profile by matchProfile, so the pass is given the IR which was instrumented, after -cs201-profile-use so
+   * that the branch weights it adds guide the block placement of the code generator as well.
+   */
+  struct CS201ProfileLayout : public ModulePass {
+
+    static char ID;
+
+    CS201ProfileLayout() : ModulePass(ID) {}
+
+    /*
+     * The runOnModule method lays out the blocks and functions of the module.
+     */
+    bool runOnModule(Module &M) override {
+
+      multimap<string, CS201FunctionProfile> profiles;
+      if(!readProfile(profiles))
+        return false;
+
+      // The profiles are matched and the calls counted before the pass changes any function. The profiled functions are kept in the order of the
+      // module, so that the layout does not depend on their addresses.
+      vector<Function*> profiled;
+      map<Function*, ProfiledFunction> functions;
+      map<Function*, map<Function*, uint64_t>> callers;
+      for(auto &F: M) {
+        if(F.isDeclaration())
+          continue;
+        ProfiledFunction function;
+        if(!matchProfile(F, profiles, function, "laid out"))
+          continue;
+        countCalls(F, function, callers);
+        profiled.push_back(&F);
+        swap(functions[&F], function);
+      }
+
+      vector<Function*> coldFunctions;
+      for(Function *F: profiled) {
+        ProfiledFunction &function = functions[F];
+        layoutBlocks(function);
+        if(function.entryCount == 0)
+          coldFunctions.push_back(F);
+        else if(SplitColdBlocks)
+          splitColdRegions(*F, function, coldFunctions);
+      }
+      orderFunctions(M, profiled, functions, callers, coldFunctions);
+      return !profiled.empty();
+    }
+
+    /*
+     * The following method adds the calls made by a profiled function to the functions of the module, the count of a call being the count of its
+     * block, to the calls of every callee by caller.
+     */
+    void countCalls(Function &F, ProfiledFunction &function, map<Function*, map<Function*, uint64_t>> &callers) {
+
+      for(uint32_t v = 0; v < function.blocks.size(); ++v) {
+        if(function.blockCounts[v] <= 0)
+          continue;
+        for(auto &I: *function.blocks[v]) {
+          CallSite CS(&I);
+          if(!CS)
+            continue;
+          Function *callee = dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts());
+          if(callee && callee != &F && !callee->isDeclaration())
+            callers[callee][&F] += function.blockCounts[v];
+        }
+      }
+    }
+
+    /*
+     * The following method orders the blocks of a function by chaining its hottest edges, the entry block staying first.
+     */
+    void layoutBlocks(ProfiledFunction &function) {
+
+      uint32_t numBlocks = function.blocks.size();
+      auto edgeCount = [&](uint32_t e) -> uint64_t { return max(function.edgeCounts[e], (int64_t) 0); };
+      vector<vector<uint32_t>> chains(numBlocks);
+      vector<uint32_t> chainOf(numBlocks);
+      // The edges of every block, in both directions.
+      vector<vector<uint32_t>> blockEdges(numBlocks);
+      for(uint32_t v = 0; v < numBlocks; ++v) {
+        chains[v].push_back(v);
+        chainOf[v] = v;
+      }
+      vector<uint32_t> hotEdges;
+      for(uint32_t e = 0; e < function.edges.size(); ++e) {
+        blockEdges[function.edges[e].first].push_back(e);
+        blockEdges[function.edges[e].second].push_back(e);
+        if(edgeCount(e) > 0)
+          hotEdges.push_back(e);
+      }
+
+      stable_sort(hotEdges.begin(), hotEdges.end(), [&](uint32_t a, uint32_t b) { return edgeCount(a) > edgeCount(b); });
+      for(uint32_t e: hotEdges) {
+        uint32_t src = function.edges[e].first, dst = function.edges[e].second;
+        uint32_t first = chainOf[src], second = chainOf[dst];
+        if(dst == 0 || first == second || chains[first].back() != src || chains[second].front() != dst)
+          continue;
+        for(uint32_t v: chains[second]) {
+          chains[first].push_back(v);
+          chainOf[v] = first;
+        }
+        chains[second].clear();
+      }
+
+      // The chains are placed by decreasing (connection to the placed chains, block executions, -position of their first block).
+      vector<uint64_t> connection(numBlocks, 0), executions(numBlocks, 0);
+      for(uint32_t v = 0; v < numBlocks; ++v)
+        executions[chainOf[v]] += max(function.blockCounts[v], (int64_t) 0);
+      typedef pair<pair<uint64_t, uint64_t>, int64_t> ChainKey;
+      priority_queue<pair<ChainKey, uint32_t>> queue;
+      for(uint32_t c = 0; c < numBlocks; ++c) {
+        if(!chains[c].empty() && c != chainOf[0])
+          queue.push(make_pair(ChainKey(make_pair(0, executions[c]), -(int64_t) chains[c].front()), c));
+      }
+      vector<bool> placed(numBlocks, false);
+      vector<BasicBlock*> layout;
+      uint32_t next = chainOf[0];
+      while(true) {
+        placed[next] = true;
+        for(uint32_t v: chains[next]) {
+          layout.push_back(function.blocks[v]);
+          for(uint32_t e: blockEdges[v]) {
+            uint32_t other = chainOf[function.edges[e].first == v ? function.edges[e].second : function.edges[e].first];
+            if(placed[other] || edgeCount(e) == 0)
+              continue;
+            connection[other] += edgeCount(e);
+            queue.push(make_pair(ChainKey(make_pair(connection[other], executions[other]), -(int64_t) chains[other].front()), other));
+          }
+        }
+        // The entries of a chain whose connection grew since they were pushed are stale.
+        while(!queue.empty() && (placed[queue.top().second] || queue.top().first.first.first != connection[queue.top().second]))
+          queue.pop();
+        if(queue.empty())
+          break;
+        next = queue.top().second;
+        queue.pop();
+      }
+
+      for(uint32_t i = 1; i < layout.size(); ++i)
+        layout[i]->moveAfter(layout[i - 1]);
+    }
+
+    /*
+     * The following method moves the cold regions of a function to cold functions of their own, which it adds to coldFunctions. A region is a
+     * cold block whose immediate dominator is not cold with all the blocks it dominates, if they are all cold and there are at least
+     * -cs201-cold-min-instructions instructions in them. The regions which the code extractor cannot move (with landing pads, allocas or invokes)
+     * are left alone.
+     */
+    void splitColdRegions(Function &F, ProfiledFunction &function, vector<Function*> &coldFunctions) {
+
+      auto isCold = [&](BasicBlock *BB) {
+        auto it = function.blockIds.find(BB);
+        return it != function.blockIds.end() && function.blockCounts[it->second] >= 0 && function.blockCounts[it->second] <= ColdCount;
+      };
+
+      DominatorTree DT;
+      DT.recalculate(F);
+      vector<vector<BasicBlock*>> regions;
+      for(auto &BB: F) {
+        DomTreeNode *node = DT.getNode(&BB);
+        if(!isCold(&BB) || !node || !node->getIDom() || isCold(node->getIDom()->getBlock()))
+          continue;
+        vector<BasicBlock*> region;
+        vector<DomTreeNode*> worklist(1, node);
+        unsigned numInstructions = 0;
+        bool cold = true;
+        while(!worklist.empty() && cold) {
+          DomTreeNode *next = worklist.back();
+          worklist.pop_back();
+          cold = isCold(next->getBlock());
+          region.push_back(next->getBlock());
+          numInstructions += next->getBlock()->size();
+          worklist.insert(worklist.end(), next->begin(), next->end());
+        }
+        if(cold && numInstructions >= ColdMinInstructions)
+          regions.push_back(region);
+      }
+
+      // The regions are disjoint, so every region is still whole after the ones before it were extracted.
+      unsigned numExtracted = 0;
+      for(auto &region: regions) {
+        CodeExtractor extractor(region, &DT);
+        if(!extractor.isEligible())
+          continue;
+        Function *coldFunction = extractor.extractCodeRegion();
+        if(!coldFunction)
+          continue;
+        coldFunction->setName(F.getName() + ".cold." + to_string(numExtracted++));
+        coldFunction->addFnAttr(Attribute::Cold);
+        coldFunction->addFnAttr(Attribute::NoInline);
+        coldFunctions.push_back(coldFunction);
+        DT.recalculate(F);
+      }
+    }
+
+    /*
+     * The following method orders the functions of the module: the clusters of the profiled functions which ran, the functions which were not
+     * profiled and the cold functions.
+     */
+    void orderFunctions(Module &M, vector<Function*> &profiled, map<Function*, ProfiledFunction> &functions,
+                        map<Function*, map<Function*, uint64_t>> &callers, vector<Function*> &coldFunctions) {
+
+      // Every hot function starts in a cluster of its own, with its number of instructions (once its cold regions are gone) and block executions.
+      vector<Function*> hot;
+      map<Function*, uint32_t> clusterOf;
+      vector<vector<Function*>> clusters;
+      vector<uint64_t> clusterSize, clusterExecutions;
+      for(Function *F: profiled) {
+        if(functions[F].entryCount == 0)
+          continue;
+        uint64_t size = 0, executions = 0;
+        for(auto &BB: *F)
+          size += BB.size();
+        for(auto count: functions[F].blockCounts)
+          executions += max(count, (int64_t) 0);
+        clusterOf[F] = clusters.size();
+        clusters.push_back(vector<Function*>(1, F));
+        clusterSize.push_back(size);
+        clusterExecutions.push_back(executions);
+        hot.push_back(F);
+      }
+      stable_sort(hot.begin(), hot.end(), [&](Function *a, Function *b) { return clusterExecutions[clusterOf[a]] > clusterExecutions[clusterOf[b]]; });
+
+      for(Function *F: hot) {
+        Function *caller = NULL;
+        uint64_t maxCalls = 0;
+        map<Function*, uint64_t> &calls = callers[F];
+        for(Function *candidate: profiled) {
+          auto it = calls.find(candidate);
+          if(it != calls.end() && it->second > maxCalls && clusterOf.count(candidate)) {
+            caller = candidate;
+            maxCalls = it->second;
+          }
+        }
+        if(!caller)
+          continue;
+        uint32_t to = clusterOf[caller], from = clusterOf[F];
+        if(to == from || clusterSize[to] + clusterSize[from] > ClusterSize)
+          continue;
+        for(Function *member: clusters[from]) {
+          clusters[to].push_back(member);
+          clusterOf[member] = to;
+        }
+        clusters[from].clear();
+        clusterSize[to] += clusterSize[from];
+        clusterExecutions[to] += clusterExecutions[from];
+      }
+
+      vector<uint32_t> clusterOrder;
+      for(uint32_t c = 0; c < clusters.size(); ++c) {
+        if(!clusters[c].empty())
+          clusterOrder.push_back(c);
+      }
+      stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b) {
+        return (double) clusterExecutions[a] / max(clusterSize[a], (uint64_t) 1) > (double) clusterExecutions[b] / max(clusterSize[b], (uint64_t) 1);
+      });
+
+      vector<Function*> order;
+      for(uint32_t c: clusterOrder)
+        order.insert(order.end(), clusters[c].begin(), clusters[c].end());
+      set<Function*> cold(coldFunctions.begin(), coldFunctions.end());
+      for(auto &F: M) {
+        if(!F.isDeclaration() && !clusterOf.count(&F) && !cold.count(&F))
+          order.push_back(&F);
+      }
+      for(Function *F: coldFunctions) {
+        if(!ColdSection.empty())
+          F->setSection(ColdSection);
+        order.push_back(F);
+      }
+      for(Function *F: order) {
+        F->removeFromParent();
+        M.getFunctionList().push_back(F);
+      }
+    }
+  };
+}
+
+/*
+ * We initialize pass ID here. LLVM uses ID’s address to identify a pass.
+ */
+char CS201ProfileUse::ID = 0;
+/*
+ * We register our class here.
+ */
+static RegisterPass<CS201ProfileUse> Y("cs201-profile-use", "CS201 Profile Use Pass", false, false);
+
+char CS201ProfileLayout::ID = 0;
+/*
+ * We register the layout pass here.
+ */
+static RegisterPass<CS201ProfileLayout> L("cs201-layout", "CS201 Profile Guided Layout Pass", false, false);
@@ -5,14 +5,43 @@
  *
  */
 
+#include "CS201ProfileCFG.h"
+#include "CS201ProfileReader.h"
+#include "runtime/CS201ProfilingRuntime.h"
+
 #include "llvm/Pass.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Type.h"
-
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <list>
 #include <map>
 #include <set>
 #include <stack>
@@ -20,20 +49,309 @@
 using namespace llvm;
 using namespace std;
 
+#define DEBUG_TYPE "cs201-profiling"
+
+/*
+ * The statistics of the pass are printed by opt -stats, and the time of its phases (in its own section of the report) by opt -time-passes.
+ */
+STATISTIC(NumFunctions, "Number of functions instrumented");
+STATISTIC(NumSkippedFunctions, "Number of functions left out by the filters or -incremental");
+STATISTIC(NumBlocks, "Number of blocks instrumented");
+STATISTIC(NumEdges, "Number of edges instrumented");
+STATISTIC(NumLoops, "Number of loops instrumented");
+STATISTIC(NumCounterBytes, "Number of bytes of counters");
+STATISTIC(NumDescriptorBytes, "Number of bytes of the module descriptor and the tables it points to");
+
+/*
+ * The diagnostic output of the pass is off by default, as printing every instruction of a large module takes longer than instrumenting it.
+ * Warnings are always printed.
+ */
+static cl::opt<unsigned> Verbosity("profiling-verbosity",
+    cl::desc("Diagnostic output: 0 none, 1 the functions and their paths and counters, 2 also every block, instruction, dominator and loop"),
+    cl::init(0));
+
+/*
+ * When this option is set, edge counters are placed only on the edges which are not part of a maximum spanning tree of the CFG,
+ * and all the block and edge counts are rebuilt from these counters before printing.
+ */
+static cl::opt<bool> SpanningTreeCounters("spanning-tree-counters",
+    cl::desc("Place edge counters only on the chords of a maximum spanning tree of the CFG"), cl::init(false));
+
+/*
+ * Ball-Larus path profiling is done by default. Functions with at most -path-profile-dense-limit paths get one counter per path, and the
+ * others count their paths in an open addressing hash table with -path-profile-table-size slots.
+ */
+static cl::opt<bool> PathProfiling("path-profiling",
+    cl::desc("Count the executed acyclic paths of every function"), cl::init(true));
+static cl::opt<unsigned> PathProfileDenseLimit("path-profile-dense-limit",
+    cl::desc("Largest number of paths of a function which gets one counter per path"), cl::init(4096));
+static cl::opt<unsigned> PathProfileTableSize("path-profile-table-size",
+    cl::desc("Number of slots of the path hash table of a function with too many paths (rounded up to a power of two)"), cl::init(1024));
+
+/*
+ * Selects how the counters are updated. Plain counters use a load, add and store, which loses counts when several threads execute the same code.
+ * Atomic counters use a relaxed atomic add. Sharded counters are incremented in thread local copies of the counter arrays, which are merged into
+ * the global counters when a thread exits and before the profiling data is printed.
+ */
+enum CounterMode { PlainCounters, AtomicCounters, ShardedCounters };
+static cl::opt<CounterMode> CounterUpdateMode("counter-mode",
+    cl::desc("How the counters are updated"),
+    cl::values(clEnumValN(PlainCounters, "plain", "Non atomic updates (single threaded programs)"),
+               clEnumValN(AtomicCounters, "atomic", "Relaxed atomic updates of the global counters"),
+               clEnumValN(ShardedCounters, "sharded", "Per thread counters merged at thread exit"),
+               clEnumValEnd),
+    cl::init(PlainCounters));
+
+/*
+ * The block, edge and path counters are 64 bit, so that they do not wrap in long runs. With this option they are 32 bit counters which stop at
+ * their largest value instead, to halve the memory of the counters. A saturating increment needs a compare, so it is only done with plain counters.
+ */
+static cl::opt<bool> SaturatingCounters("saturating-counters",
+    cl::desc("Use 32 bit counters which saturate instead of 64 bit counters (with -counter-mode=plain)"), cl::init(false));
+
+/*
+ * The profiling runtime dumps the profiling data when the program exits. Besides printing it, the counts are written to the binary profile file
+ * named by the CS201_PROFILE_FILE environment variable (see CS201ProfileFormat.h), merging them into the file if it holds a profile of the same program.
+ */
+static cl::opt<bool> BinaryProfile("binary-profile",
+    cl::desc("Write the counts to a binary profile file when the program exits"), cl::init(true));
+
+/*
+ * When this option is set, all the counters of a module are placed in one page aligned block, which the profiling runtime maps from the live counters
+ * file named by the CS201_COUNTERS_FILE environment variable. Another process can then read and clear the counters while the program runs.
+ */
+static cl::opt<bool> MmapCounters("mmap-counters",
+    cl::desc("Keep the counters in a memory mapped file which can be read while the program runs"), cl::init(false));
+
+/*
+ * With sampling every function runs an uninstrumented copy of its code, which checks a countdown at the function entry and on the loop back edges.
+ * Every -sample-interval checks the countdown runs out and the execution moves to the instrumented code until the next back edge or return.
+ * The counts are then estimates, scaled by the sampling interval, which can be changed at run time with the CS201_SAMPLE_INTERVAL environment variable.
+ */
+static cl::opt<bool> Sampling("sampling",
+    cl::desc("Only count one out of every -sample-interval function entries and loop iterations"), cl::init(false));
+static cl::opt<unsigned> SampleInterval("sample-interval",
+    cl::desc("Default number of checks between two samples"), cl::init(1000));
+
+/*
+ * Value profiling counts the most frequent values of the callee of every indirect call, of the length of every memcpy, memmove and memset and of the
+ * divisor of every integer division and remainder, in a table of -value-profile-slots values per site along with a count of the other values.
+ */
+static cl::opt<bool> ValueProfiling("value-profiling",
+    cl::desc("Count the most frequent indirect call targets, memory intrinsic lengths and divisors"), cl::init(false));
+static cl::opt<unsigned> ValueProfileSlots("value-profile-slots",
+    cl::desc("Number of values counted at every value profiling site"), cl::init(4));
+
+/*
+ * With calling context profiling every function also counts its blocks in the node of the calling context tree of its current calling context, which
+ * the runtime prints when the program exits. Contexts deeper than -calling-context-depth functions are cut, the calls made at that depth being counted
+ * in the same node as the one which made them.
+ */
+static cl::opt<bool> CallingContext("calling-context",
+    cl::desc("Count the blocks of every function per calling context"), cl::init(false));
+static cl::opt<unsigned> CallingContextDepth("calling-context-depth",
+    cl::desc("Largest depth of the calling context tree"), cl::init(8));
+
+/*
+ * With timing every function and every loop reads the cycle counter when it is entered and left, and the runtime accumulates the inclusive time of
+ * every function and loop and its exclusive time, the time not spent in the functions it called (see instrumentTiming).
+ */
+static cl::opt<bool> Timing("timing",
+    cl::desc("Time every function and loop with the cycle counter"), cl::init(false));
+
+/*
+ * Memory profiling counts the loads and stores of every block, and classifies the address strides of the loads and stores made inside loops between
+ * consecutive iterations of their innermost loop (see instrumentMemoryAccesses).
+ */
+static cl::opt<bool> MemoryProfiling("memory-profiling",
+    cl::desc("Count the loads and stores of every block and profile the strides of the ones inside loops"), cl::init(false));
+
+/*
+ * Coverage only records whether every block and edge ran, in one byte flag per block and edge which is set the first time it runs, instead of
+ * counting. The runtime writes the flags as a packed bitmap (see CS201ProfileFormat.h). The counting options are ignored.
+ */
+static cl::opt<bool> Coverage("coverage",
+    cl::desc("Only record which blocks and edges ran, with one flag per block and edge"), cl::init(false));
+
+/*
+ * When this option is set, the block and edge counters incremented inside a loop which calls no function are kept in local variables, which are added
+ * to the counters when the loop is left. The counters are then only up to date outside such loops.
+ */
+static cl::opt<bool> PromoteLoopCounters("promote-loop-counters",
+    cl::desc("Keep the counters of the loops without calls in registers until the loop exits"), cl::init(false));
+
+/*
+ * Only the functions whose name matches one of the -instrument-functions regular expressions (if any are given) and none of the -skip-functions ones
+ * are instrumented. Both options can be given several times.
+ */
+static cl::list<string> InstrumentFunctions("instrument-functions",
+    cl::desc("Only instrument the functions whose name matches this regular expression"), cl::value_desc("regex"), cl::ZeroOrMore);
+static cl::list<string> SkipFunctions("skip-functions",
+    cl::desc("Do not instrument the functions whose name matches this regular expression"), cl::value_desc("regex"), cl::ZeroOrMore);
+
+/*
+ * With incremental instrumentation the binary profile of a previous run (-previous-profile) selects the functions which are instrumented: the hot ones,
+ * entered at least -incremental-hot-percent percent as often as the most frequently entered function of the profile, or the ones whose CFG changed
+ * since the profile was taken. Functions which are not in the profile or whose CFG changed are instrumented in both modes.
+ */
+enum IncrementalMode { AllFunctions, HotFunctions, ChangedFunctions };
+static cl::opt<IncrementalMode> Incremental("incremental",
+    cl::desc("Only instrument some functions, chosen from a previous profile"),
+    cl::values(clEnumValN(AllFunctions, "all", "Instrument every function"),
+               clEnumValN(HotFunctions, "hot", "Instrument the hot functions of the previous profile"),
+               clEnumValN(ChangedFunctions, "changed", "Instrument the functions whose CFG changed since the previous profile"),
+               clEnumValEnd),
+    cl::init(AllFunctions));
+static cl::opt<string> PreviousProfile("previous-profile",
+    cl::desc("Binary profile used by -incremental"), cl::value_desc("file"), cl::init(CS201_PROFILE_FILE_DEFAULT));
+static cl::opt<unsigned> IncrementalHotPercent("incremental-hot-percent",
+    cl::desc("Entry count, in percent of the largest one, from which a function is hot"), cl::init(1));
+
 namespace {
 
+  // Identifies the counter arrays of a function which can appear in a counter expression.
+  enum CounterArray { BlockCounters = 0, EdgeCounters = 1 };
+
+  // A count expressed as a signed sum of counter array elements. The key is the counter array and the index of the element inside it,
+  // and the value is the coefficient of that element.
+  typedef map<pair<int, int>, int> CounterExpr;
+
+  // Identifies the kind of an edge of the acyclic graph used for path numbering.
+  enum PathEdgeKind { RealEdge, EntryDummyEdge, ExitDummyEdge, ExitEdge };
+
+  // An edge of the acyclic graph used for path numbering. The end points are block ids, or the number of blocks for the virtual exit block.
+  struct PathEdge {
+    int src;
+    int dst;
+    int kind;
+    // The value of the edge in the path numbering and the increment of the path register on the edge after moving the values to the chords.
+    uint64_t val = 0;
+    int64_t inc = 0;
+  };
+
+  // Stores the path counters of a function. Dense functions have one counter per path and an array of path names, the others have a hash
+  // table with the key (path number + 1) and counter of every slot, and an overflow counter for the paths which did not fit in the table.
+  struct PathProfileInfo {
+    bool dense = false;
+    uint64_t numPaths = 0;
+    uint64_t tableSize = 0;
+    GlobalVariable *counters = NULL;
+    GlobalVariable *names = NULL;
+    GlobalVariable *keys = NULL;
+    GlobalVariable *overflow = NULL;
+    // The path register, and its value at the start of the paths which start at every loop header.
+    AllocaInst *pathRegister = NULL;
+    map<int, int64_t> headerStarts;
+  };
+
+  // Identifies the kind of value counted at a value profiling site (see CS201ValueSite).
+  enum ValueSiteKind { CalleeSite = CS201_VALUE_CALLEE, LengthSite = CS201_VALUE_LENGTH, DivisorSite = CS201_VALUE_DIVISOR };
+
+  // A value profiling site of a function, with the name under which its values are printed.
+  struct ValueSite {
+    int kind;
+    string name;
+  };
+
+  // A call of a function, other than an intrinsic or inline assembly: the block making it and the name of the callee, empty for an indirect call.
+  struct CallSiteInfo {
+    int block;
+    Instruction *call;
+    string callee;
+  };
+
+  // A load or store inside a loop whose address strides are profiled, with the name under which its strides are printed.
+  struct MemorySite {
+    int block;
+    Instruction *access;
+    Value *pointer;
+    string name;
+  };
+
+  // The number of buckets of the trip count histogram of a loop. Bucket b counts the entries with a trip count in [2^b, 2^(b+1)), and the last
+  // bucket every larger trip count.
+  const int TripCountBuckets = CS201_TRIP_COUNT_BUCKETS;
+
+  // A natural loop, made of the blocks which reach one of its latches without going through the header. The back edges which share a header
+  // form one loop.
+  struct NaturalLoop {
+    int header;
+    // The latches of the back edges latch -> header, and the indices of these edges in the edges of the function.
+    vector<int> latches;
+    vector<int> backEdges;
+    // The ids of the blocks of the loop, in increasing order.
+    vector<int> blocks;
+  };
+
+  // Stores what the pass knows about a function. Blocks are identified by their position in the function (the entry block is 0),
+  // and edges by their position in the edge list, which is also the index of their edge counter.
+  struct FunctionInfo {
+    string name;
+    vector<BasicBlock*> blocks;
+    // The id of every block of the function as it was before the instrumentation.
+    DenseMap<BasicBlock*, int> blockIds;
+    // The distinct successors of every block in the order of the successor slots of its terminator, and its distinct predecessors.
+    vector<vector<int>> successors;
+    vector<vector<int>> predecessors;
+    // The distinct edges (src, dst) ordered by source block and then like the successors. The edges leaving block v start at firstEdge[v].
+    vector<pair<int, int>> edges;
+    vector<int> firstEdge;
+    // The identities of the blocks which the binary profile stores (see CS201BlockRecord), by block id, and the structural hash of the function.
+    vector<uint64_t> blockHashes;
+    vector<uint32_t> blockLines;
+    uint64_t structuralHash = 0;
+    // The immediate dominator of every block, the entry block being its own and the unreachable blocks having -1. Block a dominates
+    // block b when the interval [domPre, domPost] of a in the dominator tree contains the one of b.
+    vector<int> idom;
+    vector<int> domPre;
+    vector<int> domPost;
+    vector<NaturalLoop> loops;
+    // The number of loops containing every block.
+    vector<int> loopDepth;
+    // The estimated frequency of every edge, and of the edge to the virtual exit block of every block (zero for the blocks with successors).
+    vector<double> edgeWeights;
+    vector<double> exitWeights;
+    // The counter array of the function, its numBlockCounters block counters followed by its edge counters (the chord counters with spanning
+    // tree placement, which has no block counters), and the counter expressions of the blocks and edges.
+    GlobalVariable *counters = NULL;
+    unsigned numBlockCounters = 0;
+    vector<CounterExpr> blockCounts;
+    vector<CounterExpr> edgeCounts;
+    // The path counters, if the function is path profiled.
+    PathProfileInfo paths;
+    // The trip count histograms of the loops, TripCountBuckets counters per loop, or NULL.
+    GlobalVariable *loopHistogram = NULL;
+    // The calls made by the function, in the order of the function.
+    vector<CallSiteInfo> callSites;
+    // The value profiling sites of the function and their tables, with ValueProfileSlots values and ValueProfileSlots + 1 counts per site, the last count
+    // being the one of the values which are not in the table.
+    vector<ValueSite> valueSites;
+    GlobalVariable *siteValues = NULL;
+    GlobalVariable *siteCounts = NULL;
+    // Whether the counters of the function are only updated in the sampled executions.
+    bool sampled = false;
+    // The array of the names of the blocks, shared by the module descriptor and the calling context profiling, or NULL until it is needed.
+    GlobalVariable *blockNames = NULL;
+    // The inclusive and exclusive times of the function followed by the ones of every loop with -timing, or NULL.
+    GlobalVariable *timeCounters = NULL;
+    // The number of loads and stores of every block (two numbers per block) and the stride profiling sites with -memory-profiling, with
+    // CS201_STRIDE_CLASSES stride counters and the last constant stride of every site.
+    vector<uint32_t> blockAccesses;
+    vector<MemorySite> memorySites;
+    GlobalVariable *strideCounters = NULL;
+    GlobalVariable *strides = NULL;
+    // The coverage flags of the blocks followed by the ones of the edges with -coverage, or NULL.
+    GlobalVariable *coverage = NULL;
+  };
+
   /*
-   * The following method is used to generate the code for printf function.
+   * The following method returns the declaration of a C library function, creating it the first time.
    */
-  static Function* printf_prototype(LLVMContext& ctx, Module *mod) {
+  static Function* getLibFunction(Module &M, string name, Type *returnType, std::vector<Type*> &argTypes, bool isVarArg = false) {
 
-      std::vector<Type*> printf_arg_types;
-      printf_arg_types.push_back(Type::getInt8PtrTy(ctx));
-      FunctionType* printf_type = FunctionType::get(Type::getInt32Ty(ctx), printf_arg_types, true);
-      Function *func = mod->getFunction("printf");
+      Function *func = M.getFunction(name);
       if(!func)
-        func = Function::Create(printf_type, Function::ExternalLinkage, Twine("printf"), mod);
-      func->setCallingConv(CallingConv::C);
+        func = Function::Create(FunctionType::get(returnType, argTypes, isVarArg), Function::ExternalLinkage, name, &M);
       return func;
     }
 
@@ -44,40 +362,101 @@ namespace {
    *    In order to compute the basic block profiling data we have maintained global variables (of type one dimensional array) corresponding to each function.
    *    The corresponding variables are incremented as soon as the basic block is executed. This has been achieved by inserting an instruction at the start of 
    *    every basic block to increment the corresponding value in the global variable for the function using the name of the current basic block.
-   *    Finally we print the basic block profiling data by printing the values of these global variables at the end of the main function.
+   *    Finally we print the basic block profiling data by printing the values of these global variables when the program exits.
    * 2. Edge profiling:
-   *    In order to compute the edge profiling data we have maintained global variables (of type two dimensional integer array) corresponding to each function.
-   *    The indices of these array correspond to the end points of the edge. We also maintain a global variable to store the index of previously executed block.
-   *    At the start of the basic block using the index of current basic block and index of previously executed basic block we find and increment the counter for
-   *    corresponding edge in the two dimensional map for a fucntion. Finally we print the edge profiling data by using these global variables at the end of the main function.
-   * 3. Loop iteration count:
-   *    In oder to compute the loop iteration count we simply use the edge execution count of the back edge of a loop. We store all the loops corresponding to a function
-   *    while performing the basic program analysis. We then use this information to find the back edges and use the global variables used for edge profiling to get
-   *    execution counts of these back edges.
+   *    In order to compute the edge profiling data we have maintained global variables (of type one dimensional integer array) corresponding to each function,
+   *    with one element for each edge of the function, the edges being ordered by source block and successor. The counter is incremented on the edge itself: at the end of the source
+   *    block if the edge is its only way out, at the start of the destination block if the edge is its only way in, and otherwise in a new block created by splitting
+   *    the critical edge. The few edges which cannot be split are computed from the block count of their destination (or source) and the other edges.
+   *    Finally we print the edge profiling data by using these global variables when the program exits.
+   * 3. Loop profiling:
+   *    We store all the loops corresponding to a function, keyed by their header together with their back edges, while performing the basic program analysis.
+   *    The number of entries of a loop is the count of the edges into its header from outside the loop, and its number of iterations is the count of its
+   *    header. The number of iterations of every entry (trip count) is counted in a register which is cleared on the entry edges and incremented on the
+   *    back edges, and a histogram of the trip counts with power of two buckets is updated on the exit edges (see instrumentLoops).
+   *    The analyses identify the blocks by their position in the function, the dominators are computed with the algorithm of Cooper, Harvey and Kennedy.
+   * 4. Optimal counter placement (-spanning-tree-counters):
+   *    Instead of the above counters we compute a maximum spanning tree of the CFG (extended with a virtual exit block and an edge from it back to the entry block)
+   *    using estimated edge frequencies as weights, and only count the edges which are not part of the tree (chords). Since the flow into every block is equal
+   *    to the flow out of it, the count of every tree edge and every block can be written as a signed sum of chord counters, which we compute at compile time
+   *    and evaluate when printing the profiling data.
+   * 5. Value profiling (-value-profiling):
+   *    Before every indirect call, memory intrinsic with a variable length and integer division or remainder by a variable we pass the callee, length
+   *    or divisor to the runtime, which keeps the most frequent values of the site in a small table (see instrumentValues).
+   * 6. Call edges and calling contexts:
+   *    The number of calls made by a call site is the count of its block, so the call edge table is printed from the block counts. With -calling-context
+   *    every function asks the runtime for the counters of its calling context when it is entered, and counts its blocks in them as well (see
+   *    instrumentContexts).
+   * 7. Timing (-timing):
+   *    Every function and loop tells the runtime when it is entered and left, and the runtime reads the cycle counter to accumulate the inclusive and
+   *    exclusive time of every function and loop, the calibrated cost of the timer reads being subtracted (see instrumentTiming).
+   * 8. Memory profiling (-memory-profiling):
+   *    The loads and stores of every block are counted from its block count, and the loads and stores inside loops classify the stride of their
+   *    address between consecutive iterations of their innermost loop (see instrumentMemoryAccesses).
+   * 9. Coverage (-coverage):
+   *    Instead of all the above, every block and edge only sets a one byte flag the first time it runs, and the runtime writes the flags as a bitmap
+   *    (see instrumentCoverage).
+   * Every instrumented module registers a descriptor of its functions and counters with the profiling runtime (runtime/), which dumps the profile of
+   * all the modules of the program when it exits. The binary profile identifies every block by a hash of its instructions and its line as well as
+   * by its position, so that the profile can still be used once the function changed (see computeCS201BlockHashes).
    */
   struct CS201Profiling : public FunctionPass {
 
     static char ID;
     // Stores the context to be used later.
     LLVMContext *Context;
-    // Stores the printf function which is then used to print profiling data.
-    Function *printf_func = NULL;
-    // Stores the global variable which is used to store the id of previously executed basic block.
-    GlobalVariable *previousBlockID = NULL;
-    // Stores the function name and the corresponding global variable of type one dimensional array (which stores the basic block count).
-    map<string, GlobalVariable*> bbCounters;
-    // Stores the function name and the corresponding set of basic blocks.
-    map<string, set<string>> basicBlockMap;
-    // Stores the function name and corresponding map of block names and corresponding block IDs.
-    map<string, map<string, int>> blockIdMap;
-    // Stores the function name and corresponding global variable of type two dimensional array (which stores the edge count).
-    map<string, GlobalVariable*> edgeCounters;
-    // Stores the name of the function and corresponding set of edges.
-    map<string, set<pair<string, string>>> edgeMap;
-    // Stores the name of the function and corresponding set of loops. 
-    map<string, set<set<string>>> loopMap;
-
-    CS201Profiling() : FunctionPass(ID) {}
+    // Stores the information about every instrumented function, in the order of the module.
+    vector<FunctionInfo> functions;
+    // Stores the last function of the module selected by the function filters and the number of defined functions of the module, found when
+    // runOnFunction first runs, and whether finishModule has run.
+    Function *lastFunction = NULL;
+    unsigned numDefined = 0;
+    bool moduleListed = false;
+    bool moduleFinished = false;
+    // Stores the counter arrays and their thread local shards, in the order in which the shards were created.
+    vector<pair<GlobalVariable*, GlobalVariable*>> shardedCounters;
+    // Stores the thread local shard of every sharded counter array.
+    map<GlobalVariable*, GlobalVariable*> counterShards;
+    // Stores the thread local flag which is set once the current thread has registered its shards.
+    GlobalVariable *shardRegistered = NULL;
+    // Stores the function which registers the shards of the current thread and the function which merges them into the global counters.
+    Function *registerShardFunc = NULL;
+    Function *flushShardFunc = NULL;
+    // Stores the page aligned block holding all the counters of the module with -mmap-counters, and the address inside it of every counter array.
+    GlobalVariable *mergedCounters = NULL;
+    map<GlobalVariable*, Constant*> mergedCounterAddresses;
+    // Stores the blocks created by splitting the critical edges of the current function, keyed by the end points of the split edge.
+    map<pair<BasicBlock*, BasicBlock*>, BasicBlock*> edgeBlocks;
+    // Stores the increments of counters at a constant index in the current function: the address of the counter and the store or atomic add.
+    vector<pair<Value*, Instruction*>> counterUpdates;
+    // Stores the countdown to the next sample and the sampling interval with -sampling.
+    GlobalVariable *sampleCountdown = NULL;
+    GlobalVariable *sampleInterval = NULL;
+    Function *nextSampleFunc = NULL;
+    // Stores the uninstrumented copy of every block of the current function with -sampling, and the stack slots of its values.
+    vector<BasicBlock*> checkingBlocks;
+    vector<AllocaInst*> checkingSlots;
+    // Stores the compiled -instrument-functions and -skip-functions expressions.
+    list<Regex> instrumentRegexes;
+    list<Regex> skipRegexes;
+    // Stores the functions of the previous profile by name with -incremental, and the entry count from which a function is hot.
+    multimap<string, CS201FunctionProfile> previousProfiles;
+    uint64_t hotEntryCount = 0;
+    // Stores the timers of the phases of the pass, which are only started with -time-passes. The group prints them when the pass is destroyed.
+    TimerGroup phaseTimers;
+    Timer analysisTimer;
+    Timer instrumentationTimer;
+    Timer descriptorTimer;
+
+    CS201Profiling() : FunctionPass(ID), phaseTimers("CS201 Profiling phases"), analysisTimer("Analysis", phaseTimers),
+                       instrumentationTimer("Instrumentation", phaseTimers), descriptorTimer("Descriptor generation", phaseTimers) {}
+
+    /*
+     * The following method returns the timer of a phase when the phases are timed, or NULL, which TimeRegion ignores.
+     */
+    Timer* phaseTimer(Timer &timer) {
+      return TimePassesIsEnabled ? &timer : NULL;
+    }
 
     /*
      * The doInitialization method is allowed to do most of the things that FunctionPasses are not allowed to do. They can add and remove functions,
@@ -87,471 +466,2665 @@ namespace {
     bool doInitialization(Module &M) override {
       
       Context = &M.getContext();
-      printf_func = printf_prototype(*Context, &M);
 
-      errs() << "\nModule: " << M.getName() << "\n";
-      for(auto &F : M) {
+      // The sampled executions enter the loops at their header, so the counts do not satisfy the flow conservation used by the spanning tree placement.
+      if(Sampling && SpanningTreeCounters) {
+        errs() << "Warning: -spanning-tree-counters cannot be used with -sampling, every edge is counted\n";
+        SpanningTreeCounters = false;
+      }
+      // The checking code would have to keep the calling context too, so only one of them is done.
+      if(Sampling && CallingContext) {
+        errs() << "Warning: -calling-context cannot be used with -sampling, the calling contexts are not profiled\n";
+        CallingContext = false;
+      }
+      if(IncrementalHotPercent > 100) {
+        errs() << "Warning: -incremental-hot-percent=" << IncrementalHotPercent << " is above 100, 100 is used\n";
+        IncrementalHotPercent = 100;
+      }
+      if(SaturatingCounters && CounterUpdateMode != PlainCounters) {
+        errs() << "Warning: -saturating-counters can only be used with -counter-mode=plain, the counters are 64 bit\n";
+        SaturatingCounters = false;
+      }
+      // The coverage flags are only ever set to one, so they need neither atomic nor per thread updates, and no other instrumentation is done.
+      if(Coverage) {
+        cl::opt<bool> *countingOptions[] = { &SpanningTreeCounters, &PathProfiling, &MmapCounters, &Sampling, &ValueProfiling, &CallingContext,
+                                             &PromoteLoopCounters, &Timing, &MemoryProfiling };
+        for(auto *option: countingOptions) {
+          if(*option && option->getNumOccurrences() > 0)
+            errs() << "Warning: -" << option->ArgStr << " cannot be used with -coverage, it is ignored\n";
+          *option = false;
+        }
+        CounterUpdateMode = PlainCounters;
+      }
+      compileRegexes(InstrumentFunctions, instrumentRegexes);
+      compileRegexes(SkipFunctions, skipRegexes);
+      if(Incremental != AllFunctions)
+        readPreviousProfile();
+
+      if(Verbosity >= 1)
+        errs() << "\nModule: " << M.getName() << "\n";
+      // The functions are listed and analysed by runOnFunction, since the module passes which run before this one can remove them and the
+      // function passes can change their CFGs.
+      lastFunction = NULL;
+      numDefined = 0;
+      moduleListed = false;
+      moduleFinished = false;
+      return false;
+    }
+
+    /*
+     * The following method is called once the last filtered function of the module has been processed. It is not done in doFinalization, which the
+     * pass framework only calls after the passes which follow this one (such as the one which writes the module) have run.
+     * We create the descriptor of the module here, as by now the counters and counter expressions of every function are known irrespective of the
+     * order in which the functions were processed. A module constructor registers the descriptor with the profiling runtime, which prints the
+     * profiling data of every registered module from its descriptor and writes the binary profile when the program exits.
+     */
+    void finishModule(Module &M) {
+
+      NumSkippedFunctions += numDefined - functions.size();
+      if(functions.size() < numDefined && Verbosity >= 1)
+        errs() << "Instrumenting " << functions.size() << " of the " << numDefined << " functions of the module\n";
+      if(functions.empty())
+        return;
+
+      TimeRegion descriptorGeneration(phaseTimer(descriptorTimer));
+      NumCounterBytes += countCounterBytes(M);
+
+      if(CounterUpdateMode == ShardedCounters)
+        createShardFlush();
+
+      if(MmapCounters)
+        mergeCounters(M);
+
+      // The globals created for the descriptor are appended to the ones of the module.
+      GlobalVariable *lastGlobal = M.global_empty() ? NULL : &M.getGlobalList().back();
+      GlobalVariable *descriptor = createModuleDescriptor(M);
+      DataLayout layout(&M);
+      for(auto it = lastGlobal ? ++Module::global_iterator(lastGlobal) : M.global_begin(); it != M.global_end(); ++it)
+        NumDescriptorBytes += layout.getTypeAllocSize(it->getType()->getPointerElementType());
+      for(auto &counter: mergedCounterAddresses)
+        counter.first->eraseFromParent();
+      Function *init = Function::Create(FunctionType::get(Type::getVoidTy(*Context), false), GlobalValue::InternalLinkage, "__cs201_register", &M);
+      IRBuilder<> builder(BasicBlock::Create(*Context, "entry", init));
+      std::vector<Type*> register_arg_types;
+      register_arg_types.push_back(Type::getInt8PtrTy(*Context));
+      Function *registerModule = getLibFunction(M, "__cs201_register_module", Type::getVoidTy(*Context), register_arg_types);
+      builder.CreateCall(registerModule, builder.CreatePointerCast(descriptor, Type::getInt8PtrTy(*Context)));
+      builder.CreateRetVoid();
+      appendToGlobalCtors(M, init, 0);
+    }
 
-        int numBlocks = 0;
-        for(auto &BB : F) {
+    /*
+     * The runOnFunction method is implemented by the subclass to do the transformation or analysis work of your pass.
+     * A true value should be returned as the program is modified.
+     */
+    bool runOnFunction(Function &F) override {
 
-          // The following code sets the name for each of the basic blocks.
-          if (!BB.hasName()){
-              BB.setName("b" + to_string(numBlocks));
-          }
-          numBlocks += 1;
+      Module &M = *F.getParent();
+      // Only function passes run from now on, so the functions of the module stay the ones listed here, the pass appending its own.
+      if(!moduleListed) {
+        moduleListed = true;
+        for(auto &G : M) {
+          if(G.isDeclaration())
+            continue;
+          numDefined++;
+          if(matchesFilters(G.getName()))
+            lastFunction = &G;
+        }
+        if(!lastFunction) {
+          finishModule(M);
+          moduleFinished = true;
+        }
+      }
+      // The functions created by the pass come after the last filtered function of the module, so they are not instrumented.
+      if(moduleFinished || !matchesFilters(F.getName()))
+        return false;
+
+      bool instrumented = addFunction(F);
+      if(instrumented) {
+        // The helpers are created along with the first instrumented function, so that nothing is added to a module which is not instrumented.
+        if(functions.size() == 1) {
+          if(CounterUpdateMode == ShardedCounters)
+            createShardRegistration(M);
+          if(Sampling)
+            createSamplingCountdown(M);
         }
+        instrumentFunction(F, functions.back());
+      }
+
+      if(&F == lastFunction) {
+        finishModule(M);
+        moduleFinished = true;
+      }
+      return instrumented;
+    }
+
+    /*
+     * The following method stores the blocks, edges, block identities and calls of a function, names its blocks and creates its counter array.
+     * Returns false if the function is left out by -incremental.
+     */
+    bool addFunction(Function &F) {
+
+      TimeRegion analysis(phaseTimer(analysisTimer));
+      functions.push_back(FunctionInfo());
+      FunctionInfo &info = functions.back();
+      populateBlockInfo(F, info);
+      populatePredsAndEdges(info);
+      computeBlockHashes(info);
+      if(!isSelectedByProfile(info)) {
+        functions.pop_back();
+        return false;
+      }
+      populateCallSites(info);
 
-        // Here we create global variables (of type one dimensional array) to store basic block counts for each functions.
-        ArrayType* singleArrayType = ArrayType::get(IntegerType::get(M.getContext(), 32), numBlocks);
-        GlobalVariable* bbCountGVariable = new GlobalVariable(M, singleArrayType, false, GlobalValue::CommonLinkage, 0, "bbCounter_" + F.getName().str());;
-        ConstantAggregateZero* singleArrayInitValues = ConstantAggregateZero::get(singleArrayType);
-        bbCountGVariable->setInitializer(singleArrayInitValues);
-        bbCounters[F.getName().str()] = bbCountGVariable;
+      int numBlocks = 0;
+      for(auto &BB : F) {
 
-        // Here we create global variables (of type two dimensional array) to store edge counts for each function.
-        ArrayType* aType = ArrayType::get(ArrayType::get(IntegerType::get(M.getContext(), 32), numBlocks), numBlocks);
-        GlobalVariable* gVariable = new GlobalVariable(M, aType, false, GlobalValue::CommonLinkage, 0, "edgeCounter_" + F.getName().str());
-        ConstantAggregateZero* initValues = ConstantAggregateZero::get(aType);
-        gVariable->setInitializer(initValues);
-        edgeCounters[F.getName().str()] = gVariable;
+        // The following code sets the name for each of the basic blocks.
+        if (!BB.hasName()){
+            BB.setName("b" + to_string(numBlocks));
+        }
+        numBlocks += 1;
       }
 
-      // Here we create a global variable to (of type integer) to store id of previously executed block.
-      previousBlockID = new GlobalVariable(M, Type::getInt32Ty(*Context), false, GlobalValue::InternalLinkage, ConstantInt::get(Type::getInt32Ty(*Context), 0), "previousBlockID");
+      // With spanning tree placement the number of counters is only known after analysing the function, so the chord counters are created later.
+      if(SpanningTreeCounters)
+        return true;
+
+      Module &M = *F.getParent();
+      if(Coverage) {
+        ArrayType *coverageType = ArrayType::get(Type::getInt8Ty(M.getContext()), numBlocks + info.edges.size());
+        info.coverage = new GlobalVariable(M, coverageType, false, GlobalValue::InternalLinkage, 0, "coverage_" + F.getName().str());
+        info.coverage->setInitializer(ConstantAggregateZero::get(coverageType));
+        return true;
+      }
 
+      // Here we create the counter array of the function, which holds its block counters followed by its edge counters.
+      info.counters = createCounterArray(M, numBlocks + info.edges.size(), "counters_" + F.getName().str());
+      info.numBlockCounters = numBlocks;
       return true;
     }
 
     /*
-     * The doFinalization method is an infrequently used method that is called when the pass framework has finished calling runOnFunction
-     * for every function in the program being compiled.
+     * The following method analyses the loops of a function and instruments it.
      */
-    bool doFinalization(Module &M) override {
+    void instrumentFunction(Function &F, FunctionInfo &info) {
+
+      if(Verbosity >= 1)
+        errs() << "\nFunction: " << F.getName() << '\n';
+      edgeBlocks.clear();
+      counterUpdates.clear();
+
+      {
+        TimeRegion analysis(phaseTimer(analysisTimer));
+        populateDominatorSets(info);
+        populateLoopInfomation(info);
+        estimateEdgeWeights(info);
+      }
+      NumFunctions++;
+      NumBlocks += info.blocks.size();
+      NumEdges += info.edges.size();
+      NumLoops += info.loops.size();
+
+      Timer *instrumentation = phaseTimer(instrumentationTimer);
+      if(instrumentation)
+        instrumentation->startTimer();
+      if(Sampling)
+        createCheckingCode(F, info);
+
+      if(ValueProfiling)
+        instrumentValues(F, info);
+
+      if(MemoryProfiling)
+        info.blockAccesses.assign(2 * info.blocks.size(), 0);
+      for(unsigned v = 0; v < info.blocks.size(); ++v) {
+        runOnBasicBlock(*info.blocks[v], v, info);
+      }
+      // The functions which make no loads and stores are left out of the memory profiling data.
+      if(count(info.blockAccesses.begin(), info.blockAccesses.end(), 0) == (int) info.blockAccesses.size())
+        info.blockAccesses.clear();
 
-      return false;
-    }
+      if(Coverage)
+        instrumentCoverage(F, info);
+      else if(SpanningTreeCounters)
+        instrumentSpanningTreeChords(F, info);
+      else
+        instrumentEdges(F, info);
 
-    /*
-     * The runOnFunction method is implemented by the subclass to do the transformation or analysis work of your pass.
-     * A true value should be returned as the program is modified.
-     */
-    bool runOnFunction(Function &F) override {
+      if(PathProfiling)
+        instrumentPaths(F, info);
 
-      set<string> blocks;
-      map<string, set<string>> predecessors;
-      set<pair<string, string>> edges;
-      map<string, set<string>> dominators;
-      set<pair<string, string>> back_edges;
-      set<set<string>> loops;
-      map<string, int> block_ids;
+      instrumentLoops(F, info);
 
-      errs() << "\nFunction: " << F.getName() << '\n';
+      if(MemoryProfiling)
+        instrumentMemoryAccesses(F, info);
 
-      populateBlockInfo(F, blocks, block_ids);
-      populatePredsAndEdges(F, predecessors, edges);
-      populateDominatorSets(dominators, predecessors, blocks);
-      populateBackEdges(back_edges, edges, dominators);
-      populateLoopInfomation(F.getName(), loops, back_edges, predecessors);
+      if(CallingContext)
+        instrumentContexts(F, info);
 
-      for(auto &BB: F) {
-        runOnBasicBlock(BB, predecessors);
-        // The following code inserts the code to print the profiling data at the end of the main function.
-        if(F.getName().equals("main") && isa<ReturnInst>(BB.getTerminator())) {
-          printBasicBlockProfilingData(BB);
-          printEdgeProfilingData(BB);          
-          printLoopProfilingData(BB);
+      if(Timing)
+        instrumentTiming(F, info);
+
+      if(PromoteLoopCounters)
+        promoteLoopCounters(F, info);
+
+      if(info.sampled)
+        emitSamplingChecks(F, info);
+
+      if(CounterUpdateMode == ShardedCounters)
+        emitShardRegistration(F);
+
+      if(Verbosity >= 2) {
+        printDominatorSet(info);
+        printLoops(info);
+      }
+      if(instrumentation)
+        instrumentation->stopTimer();
+    }
+
+    /*
+     * The following method compiles the regular expressions of a function filter option. Invalid expressions are ignored with a warning.
+     */
+    void compileRegexes(cl::list<string> &patterns, list<Regex> &regexes) {
+
+      regexes.clear();
+      for(auto &pattern: patterns) {
+        regexes.emplace_back(pattern);
+        string error;
+        if(!regexes.back().isValid(error)) {
+          errs() << "Warning: invalid regular expression " << pattern << ": " << error << ", it is ignored\n";
+          regexes.pop_back();
         }
       }
+    }
 
-      printDominatorSet(dominators);
-      printLoops(loops);
+    /*
+     * The following method returns whether a function is selected by the -instrument-functions and -skip-functions options. A name matches an
+     * expression if the expression matches a part of it, so "^name$" only matches the function name.
+     */
+    bool matchesFilters(StringRef name) {
+
+      auto matchesAny = [&](list<Regex> &regexes) {
+        for(auto &regex: regexes) {
+          if(regex.match(name))
+            return true;
+        }
+        return false;
+      };
+      if(!InstrumentFunctions.empty() && !matchesAny(instrumentRegexes))
+        return false;
+      return !matchesAny(skipRegexes);
+    }
+
+    /*
+     * The following method reads the previous profile used by -incremental, and computes the entry count from which a function is hot. If the profile
+     * cannot be read every function is instrumented.
+     */
+    void readPreviousProfile() {
+
+      previousProfiles.clear();
+      ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(PreviousProfile);
+      if(!buffer) {
+        errs() << "Warning: cannot read the profile " << PreviousProfile << ": " << buffer.getError().message() << ", every function is instrumented\n";
+        Incremental = AllFunctions;
+        return;
+      }
+      vector<CS201FunctionProfile> records;
+      if(!readCS201Profile((*buffer)->getBufferStart(), (*buffer)->getBufferSize(), records)) {
+        errs() << "Warning: " << PreviousProfile << " is not a valid CS201 profile, every function is instrumented\n";
+        Incremental = AllFunctions;
+        return;
+      }
+      uint64_t maxEntryCount = 0;
+      for(auto &record: records) {
+        if(!record.blockCounts.empty())
+          maxEntryCount = max(maxEntryCount, record.blockCounts[0]);
+        previousProfiles.insert(make_pair(record.name, record));
+      }
+      hotEntryCount = getCS201HotEntryCount(maxEntryCount, IncrementalHotPercent);
+    }
 
+    /*
+     * The following method returns whether a function is selected by -incremental. The function is looked up in the previous profile by name and by
+     * its structural hash, so that a function whose blocks only moved or whose lines changed is not a changed one. A function which is not found is
+     * new or changed, and is always instrumented.
+     */
+    bool isSelectedByProfile(FunctionInfo &info) {
+
+      if(Incremental == AllFunctions)
+        return true;
+      auto range = previousProfiles.equal_range(info.name);
+      for(auto it = range.first; it != range.second; ++it) {
+        CS201FunctionProfile &profile = it->second;
+        if(profile.structuralHash != info.structuralHash)
+          continue;
+        if(Incremental == ChangedFunctions)
+          return false;
+        return !profile.blockCounts.empty() && profile.blockCounts[0] >= hotEntryCount;
+      }
       return true;
     }
 
     /*
-     * The following method stores the block names and their corresponding ids in separate lists for each function.
+     * The following method stores the blocks of a function, the position of a block in the function being its id.
      * This information is later used to compute and print the profiling information.
      */
-    void populateBlockInfo(Function &F, set<string> &blocks, map<string, int> &block_ids){
-      
-      int i = 0;
+    void populateBlockInfo(Function &F, FunctionInfo &info){
+
+      info.name = F.getName();
       for(auto &BB: F) {
-        blocks.insert(BB.getName());
-        block_ids[BB.getName()] = i++;
+        info.blockIds[&BB] = info.blocks.size();
+        info.blocks.push_back(&BB);
       }
-      blockIdMap[F.getName()] = block_ids;
-      basicBlockMap[F.getName()] = blocks;
     }
 
     /*
-     * The following method stores the predecessors and edge information for each function.
+     * The following method stores the successors, predecessors and edges of every block of a function.
      * This information is later used to compute dominator sets and populate loop information.
      */
-    void populatePredsAndEdges(Function &F, map<string, set<string>> &predecessors, set<pair<string, string>> &edges){
-       
-      for(auto &BB: F) {
-        TerminatorInst *TI = BB.getTerminator();
-        for (unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
-          string BBname = TI->getSuccessor(s)->getName();
-          auto it = predecessors.find(BBname);
-          set<string> preds;
-          if (it != predecessors.end()) {
-            preds = predecessors[BBname];
-          }
-          preds.insert(BB.getName());
-          predecessors[BBname] = preds;
-          edges.insert(make_pair(BB.getName(), BBname));
+    void populatePredsAndEdges(FunctionInfo &info){
+
+      collectCS201Edges(info.blocks, info.blockIds, info.edges, info.firstEdge);
+      info.successors.assign(info.blocks.size(), vector<int>());
+      info.predecessors.assign(info.blocks.size(), vector<int>());
+      for(auto &edge: info.edges) {
+        info.successors[edge.first].push_back(edge.second);
+        info.predecessors[edge.second].push_back(edge.first);
+      }
+    }
+
+
+    /*
+     * The following method stores the calls made by every block of a function, before the pass adds calls of its own.
+     */
+    void populateCallSites(FunctionInfo &info) {
+
+      for(unsigned v = 0; v < info.blocks.size(); ++v) {
+        for(auto &I: *info.blocks[v]) {
+          CallSite CS(&I);
+          if(!CS || CS.isInlineAsm() || isa<IntrinsicInst>(&I))
+            continue;
+          CallSiteInfo site;
+          site.block = v;
+          site.call = &I;
+          if(Function *callee = dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts()))
+            site.callee = callee->getName();
+          info.callSites.push_back(site);
         }
       }
-      edgeMap[F.getName()] = edges;
+    }
+    /*
+     * The following method returns the index of the edge src -> dst in the edges of a function, or -1 if there is no such edge.
+     */
+    int findEdge(FunctionInfo &info, int src, int dst) {
+
+      for(int e = info.firstEdge[src]; e < info.firstEdge[src + 1]; ++e) {
+        if(info.edges[e].second == dst)
+          return e;
+      }
+      return -1;
     }
 
     /*
-     * The following method computes the dominator sets from the predecessor information of all the basic blocks in the function.
-     * It uses an iterative approach which terminates on convergence i.e. when there is no change in dominator sets.
+     * The following method computes the immediate dominators of the blocks of a function with the algorithm of Cooper, Harvey and Kennedy.
+     * The blocks are visited in reverse post order, and the immediate dominator of a block is the nearest common dominator of its processed predecessors,
+     * found by walking up the current dominator tree. This is repeated until there is no change in the immediate dominators.
+     * The dominator tree is then numbered so that dominance can be checked in constant time.
      */
-    void populateDominatorSets(map<string, set<string>> &dominators, map<string, set<string>> predecessors, set<string> blocks){
-      
-      for(set<string>::iterator it = blocks.begin(), end_it = blocks.end() ; it != end_it ; ++it) {
-        if(it == blocks.begin()) {
-            set<string> domset;
-            domset.insert(*it);
-            dominators[*it] = domset;
-        } else {
-            dominators[*it] = blocks;
+    void populateDominatorSets(FunctionInfo &info){
+
+      int numBlocks = info.blocks.size();
+      vector<int> postOrder;
+      vector<bool> visited(numBlocks, false);
+      vector<pair<int, unsigned>> dfsStack;
+      dfsStack.push_back(make_pair(0, 0));
+      visited[0] = true;
+      while(!dfsStack.empty()) {
+        int v = dfsStack.back().first;
+        unsigned next = dfsStack.back().second++;
+        if(next == info.successors[v].size()) {
+          postOrder.push_back(v);
+          dfsStack.pop_back();
+          continue;
+        }
+        int w = info.successors[v][next];
+        if(!visited[w]) {
+          visited[w] = true;
+          dfsStack.push_back(make_pair(w, 0));
         }
       }
+      vector<int> postNumber(numBlocks, -1);
+      for(unsigned i = 0; i < postOrder.size(); ++i)
+        postNumber[postOrder[i]] = i;
+
+      vector<int> &idom = info.idom;
+      idom.assign(numBlocks, -1);
+      idom[0] = 0;
       bool change;
       do {
-        set<string>::iterator it = blocks.begin(), end_it = blocks.end();
-        it++;
         change = false;
-        for(; it != end_it ; ++it) {
-          set<string> old = dominators[*it];
-          set<string> temp = blocks;
-          set<string> preds = predecessors[*it];
-          for(auto pred: preds) {
-              set<string> intersect;
-              set_intersection(temp.begin(), temp.end(), dominators[pred].begin(), dominators[pred].end(),
-                    std::inserter(intersect, intersect.begin()));
-              temp = intersect;
+        for(auto it = postOrder.rbegin(), end_it = postOrder.rend(); it != end_it; ++it) {
+          int v = *it;
+          if(v == 0)
+            continue;
+          int newIdom = -1;
+          for(auto pred: info.predecessors[v]) {
+            if(idom[pred] == -1)
+              continue;
+            if(newIdom == -1) {
+              newIdom = pred;
+              continue;
+            }
+            // The blocks closer to the entry block have larger post order numbers.
+            int first = pred, second = newIdom;
+            while(first != second) {
+              while(postNumber[first] < postNumber[second])
+                first = idom[first];
+              while(postNumber[second] < postNumber[first])
+                second = idom[second];
+            }
+            newIdom = first;
           }
-          temp.insert(*it);
-          dominators[*it] = temp;
-          if(old != dominators[*it])
+          if(idom[v] != newIdom) {
+            idom[v] = newIdom;
             change = true;
+          }
         }
       } while(change);
+
+      vector<vector<int>> children(numBlocks);
+      for(int v = 1; v < numBlocks; ++v) {
+        if(idom[v] != -1)
+          children[idom[v]].push_back(v);
+      }
+      info.domPre.assign(numBlocks, -1);
+      info.domPost.assign(numBlocks, -1);
+      int counter = 0;
+      vector<pair<int, unsigned>> treeStack;
+      treeStack.push_back(make_pair(0, 0));
+      info.domPre[0] = counter++;
+      while(!treeStack.empty()) {
+        int v = treeStack.back().first;
+        unsigned next = treeStack.back().second++;
+        if(next == children[v].size()) {
+          info.domPost[v] = counter++;
+          treeStack.pop_back();
+          continue;
+        }
+        int w = children[v][next];
+        info.domPre[w] = counter++;
+        treeStack.push_back(make_pair(w, 0));
+      }
     }
 
     /*
-     * The following method computes the back edges from the dominator sets of all the basic blocks for a function.
+     * The following method checks whether block a dominates block b. Unreachable blocks neither dominate nor are dominated.
      */
-    void populateBackEdges(set<pair<string, string>> &back_edges, set<pair<string, string>> edges, map<string, set<string>> dominators){
-      
-      for(auto edge: edges) {
-        auto doms = dominators[edge.first];
-        if(doms.find(edge.second) != doms.end()){
-          back_edges.insert(edge);
-        }
-      }
+    bool dominates(FunctionInfo &info, int a, int b) {
+
+      if(info.domPre[a] == -1 || info.domPre[b] == -1)
+        return false;
+      return info.domPre[a] <= info.domPre[b] && info.domPost[b] <= info.domPost[a];
     }
 
     /*
-     * The following method computes all the loops in the current function using the back edge and predecessor information.
+     * The following method computes all the loops in the current function. An edge is a back edge when its destination dominates its source, and the
+     * loop of a back edge is found by walking the predecessors backwards from its latch until the header.
      */
-    void populateLoopInfomation(string functionName, set<set<string>> &loops, set<pair<string, string>> back_edges, map<string, set<string>> predecessors){
-      
-      for(auto edge: back_edges) {
-        set<string> loop;
-        loop.insert(edge.second);
-        stack<string> bbStack;
-        bbStack.push(edge.first);
-        loop.insert(edge.first);
+    void populateLoopInfomation(FunctionInfo &info){
+
+      int numBlocks = info.blocks.size();
+      info.loopDepth.assign(numBlocks, 0);
+      vector<int> loopOfHeader(numBlocks, -1);
+      for(unsigned e = 0; e < info.edges.size(); ++e) {
+        int latch = info.edges[e].first;
+        int header = info.edges[e].second;
+        if(!dominates(info, header, latch))
+          continue;
+        if(loopOfHeader[header] == -1) {
+          loopOfHeader[header] = info.loops.size();
+          info.loops.push_back(NaturalLoop());
+          info.loops.back().header = header;
+        }
+        NaturalLoop &loop = info.loops[loopOfHeader[header]];
+        loop.latches.push_back(latch);
+        loop.backEdges.push_back(e);
+      }
+
+      BitVector inLoop(numBlocks);
+      for(auto &loop: info.loops) {
+        loop.blocks.push_back(loop.header);
+        inLoop.set(loop.header);
+        stack<int> bbStack;
+        for(auto latch: loop.latches) {
+          if(!inLoop.test(latch)) {
+            loop.blocks.push_back(latch);
+            inLoop.set(latch);
+            bbStack.push(latch);
+          }
+        }
         while(!bbStack.empty()) {
-          auto top = bbStack.top();
+          int top = bbStack.top();
           bbStack.pop();
-          for(auto pred: predecessors[top]) {
-            if(loop.find(pred) == loop.end()){
-              loop.insert(pred);
+          for(auto pred: info.predecessors[top]) {
+            if(!inLoop.test(pred) && info.domPre[pred] != -1){
+              loop.blocks.push_back(pred);
+              inLoop.set(pred);
               bbStack.push(pred);
             }
           }
         }
-        loops.insert(loop);
+        for(auto block: loop.blocks) {
+          inLoop.reset(block);
+          info.loopDepth[block]++;
+        }
+        std::sort(loop.blocks.begin(), loop.blocks.end());
       }
-      loopMap[functionName] = loops;
     }
 
     /*
-     * The following method is used to insert code into a basic block. We insert three instructions in every basic block.
-     * 1. Instruction to increment appropriate basic block execution counter at the start of the block using the current block index.
-     * 2. Instruction to increment appropriate edge execution counter using the index of previously executed block (global variable).
-     * 3. Instruction to update the previously executed block (global variable).
+     * The following method is used to insert code into a basic block. We insert an instruction at the start of every block to increment appropriate
+     * basic block execution counter using the current block index. The edge counters are inserted by instrumentEdges.
+     * With spanning tree placement the blocks are not instrumented here, see instrumentSpanningTreeChords, and neither are they with -coverage,
+     * see instrumentCoverage.
      */
-    bool runOnBasicBlock(BasicBlock &BB, map<string, set<string>> &predecessors) {
+    bool runOnBasicBlock(BasicBlock &BB, int id, FunctionInfo &info) {
 
-      errs() << "\nBasicBlock: " << BB.getName() << '\n';
-      errs() << "Predecessors: ";
-      for(auto pred: predecessors[BB.getName()]) {
-        errs() << pred << " ";
+      if(Verbosity >= 2) {
+        errs() << "\nBasicBlock: " << BB.getName() << '\n';
+        errs() << "Predecessors: ";
+        for(auto pred: info.predecessors[id]) {
+          errs() << info.blocks[pred]->getName() << " ";
+        }
+        errs() << "\nInstructions:\n";
+        for(auto &I: BB)
+          errs() << I << "\n";
       }
-      errs() << "\nInstructions:\n";
-      for(auto &I: BB){
-        errs() << I << "\n";
+      if(MemoryProfiling) {
+        for(auto &I: BB)
+          recordMemoryAccess(I, id, info);
       }
 
-      IRBuilder<> IRB(BB.getFirstInsertionPt());
-      std::vector<Value*> edgeIndex;
-      Value* zeroIndex = ConstantInt::get(Type::getInt32Ty(*Context), 0);
-      edgeIndex.push_back(zeroIndex);
-
-      Value* indexFirst = IRB.CreateLoad(previousBlockID);
-      edgeIndex.push_back(indexFirst);
+      if(SpanningTreeCounters || Coverage)
+        return false;
 
-      Value* indexSecond = ConstantInt::get(Type::getInt32Ty(*Context), blockIdMap[BB.getParent()->getName()][BB.getName()]);
-      edgeIndex.push_back(indexSecond);
-
-      std::vector<Value*> bbIndex;
-      bbIndex.push_back(zeroIndex);
-      bbIndex.push_back(indexSecond);
-
-      Value* bbCountVal = IRB.CreateGEP(bbCounters[BB.getParent()->getName()], bbIndex);
-      Value* OldBBCountVal = IRB.CreateLoad(bbCountVal);
-      Value *bbAddCounter = IRB.CreateAdd(OldBBCountVal, ConstantInt::get(Type::getInt32Ty(*Context), 1));
-      IRB.CreateStore(bbAddCounter, bbCountVal);
-
-      Value* edgeCountVal = IRB.CreateGEP(edgeCounters[BB.getParent()->getName()], edgeIndex);
-      Value* OldEdgeCountVal = IRB.CreateLoad(edgeCountVal);
-      Value *edgeAddCounter = IRB.CreateAdd(OldEdgeCountVal, ConstantInt::get(Type::getInt32Ty(*Context), 1));
-      IRB.CreateStore(edgeAddCounter, edgeCountVal);
-
-      IRBuilder<> builder(BB.getTerminator());
-      Value *blockID = ConstantInt::get(Type::getInt32Ty(*Context), blockIdMap[BB.getParent()->getName()][BB.getName()]);
-      builder.CreateStore(blockID, previousBlockID);
+      IRBuilder<> IRB(BB.getFirstInsertionPt());
+      emitCounterIncrement(IRB, info.counters, id);
 
       return true;
     }
 
     /*
-     * The following method print the basic block profiling data for each of the functions in the program.
+     * The following method counts a load or store of a block, and makes it a stride profiling site if the block is inside a loop and the address is
+     * not the one of a local variable (an alloca, whose address does not change). The loads and stores of the stack slots of the values of the
+     * sampling copy are not counted, and there are no stride profiling sites in sampled functions, which do not run every iteration.
      */
-    void printBasicBlockProfilingData(BasicBlock& BB){
-      
-      printString(BB, "\nBASIC BLOCK PROFILING:\n");
-      for(auto &function: bbCounters){
-        printBasicBlockCount(BB, function.first, basicBlockMap[function.first], function.second);
-      }
+    void recordMemoryAccess(Instruction &I, int block, FunctionInfo &info) {
+
+      Value *pointer;
+      if(LoadInst *load = dyn_cast<LoadInst>(&I))
+        pointer = load->getPointerOperand();
+      else if(StoreInst *store = dyn_cast<StoreInst>(&I))
+        pointer = store->getPointerOperand();
+      else
+        return;
+      if(find(checkingSlots.begin(), checkingSlots.end(), pointer) != checkingSlots.end())
+        return;
+      bool store = isa<StoreInst>(&I);
+      info.blockAccesses[2 * block + store]++;
+      if(info.loopDepth[block] == 0 || info.sampled || isa<AllocaInst>(pointer->stripPointerCasts()))
+        return;
+
+      // Several sites of a kind in a block are numbered in the order of the block.
+      string name = store ? "store" : "load";
+      int number = 1;
+      for(auto it = info.memorySites.rbegin(); it != info.memorySites.rend() && it->block == block; ++it)
+        number += isa<StoreInst>(it->access) == store;
+      MemorySite site;
+      site.block = block;
+      site.access = &I;
+      site.pointer = pointer;
+      site.name = name + " in " + I.getParent()->getName().str() + (number > 1 ? " #" + to_string(number) : "");
+      info.memorySites.push_back(site);
     }
 
     /*
-     * The following method inserts a printf function at the end of the main function 
-     * to display the basic block execution count.
+     * The following method places a counter on every edge of a function and stores the counter expressions of its blocks and edges.
+     * The index of an edge counter is the index of the edge in the edges of the function. An edge which cannot be instrumented (a critical edge out of an
+     * indirectbr or into a landing pad) is computed instead as the block count of its destination minus its other incoming edges, or as the block count
+     * of its source minus its other outgoing edges, once these are known.
      */
-     void printBasicBlockCount(BasicBlock& BB, string funcName, set<string> blocks, GlobalVariable* counter){
+    void instrumentEdges(Function &F, FunctionInfo &info) {
 
-      int i = 0;
-      IRBuilder<> builder(BB.getTerminator());
-      for(auto &block : blocks){
-        ++i;
-        Constant *format_const;
-        GlobalVariable *BBPrintfFormatStr;
+      int numBlocks = info.blocks.size();
+      info.blockCounts.assign(numBlocks, CounterExpr());
+      info.edgeCounts.assign(info.edges.size(), CounterExpr());
+      for(int v = 0; v < numBlocks; ++v) {
+        info.blockCounts[v][make_pair(BlockCounters, v)] = 1;
+      }
 
-        if(i == 1) {
-          printString(BB, "\n" + funcName + ":\n");
+      vector<bool> known(info.edges.size(), false);
+      vector<int> unknown;
+      vector<vector<int>> inEdges(numBlocks);
+      for(unsigned e = 0; e < info.edges.size(); ++e) {
+        pair<int, int> &edge = info.edges[e];
+        inEdges[edge.second].push_back(e);
+        if(instrumentEdge(info.blocks[edge.first], info.blocks[edge.second], info.counters, info.numBlockCounters + e)) {
+          info.edgeCounts[e][make_pair(EdgeCounters, (int) e)] = 1;
+          known[e] = true;
+        } else {
+          unknown.push_back(e);
         }
+      }
 
-        format_const = ConstantDataArray::getString(*Context, (block + ": %d\n").c_str());
-        BBPrintfFormatStr = new GlobalVariable(*(BB.getParent()->getParent()), llvm::ArrayType::get(llvm::IntegerType::get(*Context, 8), strlen((block + ": %d\n").c_str())+1), true, llvm::GlobalValue::PrivateLinkage, format_const, "BBPrintfFormatStr");
-
-        std::vector<Constant*> indices;
-        Constant *zero = Constant::getNullValue(IntegerType::getInt32Ty(*Context));
-        indices.push_back(zero);
-        indices.push_back(zero);        
-        Constant *var_ref = ConstantExpr::getGetElementPtr(BBPrintfFormatStr, indices);
-
-        std::vector<Constant*> bbIndex;
-        ConstantInt* zeroIndex = ConstantInt::get(Type::getInt32Ty(*Context), 0);
-        bbIndex.push_back(zeroIndex);
-
-        ConstantInt* indexFirst = ConstantInt::get(Type::getInt32Ty(*Context), blockIdMap[funcName][block]);
-        bbIndex.push_back(indexFirst);
-
-        Constant* bbCountVal = ConstantExpr::getGetElementPtr(counter, bbIndex);
-
-        Value *bbCount = builder.CreateLoad(bbCountVal);
-        CallInst *call = builder.CreateCall2(printf_func, var_ref, bbCount);
-        call->setTailCall(false);
+      bool change = true;
+      while(change && !unknown.empty()) {
+        change = false;
+        for(auto it = unknown.begin(); it != unknown.end(); ) {
+          int edge = *it;
+          bool solved = false;
+          // side 0 uses the incoming edges of the destination, side 1 the outgoing edges of the source.
+          for(int side = 0; side < 2 && !solved; ++side) {
+            int block = side == 0 ? info.edges[edge].second : info.edges[edge].first;
+            vector<int> others;
+            if(side == 0)
+              others = inEdges[block];
+            else
+              for(int e = info.firstEdge[block]; e < info.firstEdge[block + 1]; ++e)
+                others.push_back(e);
+            bool complete = true;
+            CounterExpr count = info.blockCounts[block];
+            for(auto other: others) {
+              if(other == edge)
+                continue;
+              if(!known[other]) {
+                complete = false;
+                break;
+              }
+              for(auto &term: info.edgeCounts[other])
+                count[term.first] -= term.second;
+            }
+            if(complete) {
+              info.edgeCounts[edge] = count;
+              solved = true;
+            }
+          }
+          if(solved) {
+            known[edge] = true;
+            it = unknown.erase(it);
+            change = true;
+          } else {
+            ++it;
+          }
+        }
+      }
+      for(auto edge: unknown) {
+        errs() << "Warning: cannot compute the count of the edge " << info.blocks[info.edges[edge].first]->getName() << " -> "
+               << info.blocks[info.edges[edge].second]->getName() << "\n";
       }
     }
 
     /*
-     * The following method print the edge profiling data for each of the functions in the program.
+     * The following method estimates the execution frequency of every edge of a function, which is used as the edge weight of the spanning tree.
+     * A block nested inside d loops is assumed to execute 10^d times, and its frequency is divided among its successors using the branch_weights
+     * profile metadata when it is available and evenly otherwise. Blocks without successors get an edge to the virtual exit block.
+     * The weights are estimated before the function is instrumented, as splitting the edges changes the successors of the terminators.
      */
-    void printEdgeProfilingData(BasicBlock& BB){
-      
-      printString(BB, "\nEDGE PROFILING:\n");
-      for(auto &function: edgeCounters){
-        printEdgeCount(BB, function.first, edgeMap[function.first], function.second);
+    void estimateEdgeWeights(FunctionInfo &info) {
+
+      vector<double> &weights = info.edgeWeights;
+      vector<double> &exitWeights = info.exitWeights;
+      weights.assign(info.edges.size(), 0);
+      exitWeights.assign(info.blocks.size(), 0);
+      for(unsigned v = 0; v < info.blocks.size(); ++v) {
+        double frequency = pow(10.0, min(info.loopDepth[v], 30));
+
+        TerminatorInst *TI = info.blocks[v]->getTerminator();
+        unsigned numSuccessors = TI->getNumSuccessors();
+        if(numSuccessors == 0) {
+          exitWeights[v] += frequency;
+          continue;
+        }
+
+        vector<double> probabilities(numSuccessors, 1.0 / numSuccessors);
+        MDNode *profile = TI->getMetadata(LLVMContext::MD_prof);
+        if(profile && profile->getNumOperands() == numSuccessors + 1) {
+          MDString *tag = dyn_cast<MDString>(profile->getOperand(0));
+          if(tag && tag->getString().equals("branch_weights")) {
+            vector<double> branchWeights;
+            double total = 0;
+            for(unsigned s = 0; s != numSuccessors; ++s) {
+              ConstantInt *weight = mdconst::dyn_extract<ConstantInt>(profile->getOperand(s + 1));
+              branchWeights.push_back(weight ? weight->getZExtValue() : 0);
+              total += branchWeights.back();
+            }
+            if(total > 0) {
+              for(unsigned s = 0; s != numSuccessors; ++s)
+                probabilities[s] = branchWeights[s] / total;
+            }
+          }
+        }
+        // The successor slots which lead to the same block add up on its edge.
+        for(unsigned s = 0; s != numSuccessors; ++s) {
+          weights[findEdge(info, v, info.blockIds[TI->getSuccessor(s)])] += frequency * probabilities[s];
+        }
       }
     }
 
     /*
-     * The following method inserts a printf function at the end of the main function 
-     * to display the edge execution count.
+     * The following method finds the representative of the set containing the given vertex of the spanning tree (with path compression).
      */
-    void printEdgeCount(BasicBlock& BB, string funcName, set<pair<string, string>> edges, GlobalVariable* counter) {
-      
-      int i = 0;
-      IRBuilder<> builder(BB.getTerminator());
-      for(auto &edge: edges) {
-        ++i;
-        Constant *format_const;
-        GlobalVariable *EdgePrintfFormatStr;
-        if(i == 1) {
-          printString(BB, "\n" + funcName + ":\n");
-        }
-
-        format_const = ConstantDataArray::getString(*Context, (edge.first + " -> " + edge.second + ": %d\n").c_str());
-        EdgePrintfFormatStr = new GlobalVariable(*(BB.getParent()->getParent()), llvm::ArrayType::get(llvm::IntegerType::get(*Context, 8), strlen((edge.first + " -> " + edge.second + ": %d\n").c_str())+1), true, llvm::GlobalValue::PrivateLinkage, format_const, "EdgePrintfFormatStr");
-
-        std::vector<Constant*> indices;
-        Constant *zero = Constant::getNullValue(IntegerType::getInt32Ty(*Context));
-        indices.push_back(zero);
-        indices.push_back(zero);
-        Constant *var_ref = ConstantExpr::getGetElementPtr(EdgePrintfFormatStr, indices);
+    int findTreeRoot(vector<int> &parent, int vertex) {
 
-        std::vector<Constant*> edgeIndex;
-        ConstantInt* zeroIndex = ConstantInt::get(Type::getInt32Ty(*Context), 0);
-        edgeIndex.push_back(zeroIndex);
-
-        ConstantInt* indexFirst = ConstantInt::get(Type::getInt32Ty(*Context), blockIdMap[funcName][edge.first]);
-        edgeIndex.push_back(indexFirst);
-
-        ConstantInt* indexSecond = ConstantInt::get(Type::getInt32Ty(*Context), blockIdMap[funcName][edge.second]);
-        edgeIndex.push_back(indexSecond);
-
-        Constant* edgeCountVal = ConstantExpr::getGetElementPtr(counter, edgeIndex);
-
-        Value *edgeCount = builder.CreateLoad(edgeCountVal);
-        CallInst *call = builder.CreateCall2(printf_func, var_ref, edgeCount);
-        call->setTailCall(false);
+      while(parent[vertex] != vertex) {
+        parent[vertex] = parent[parent[vertex]];
+        vertex = parent[vertex];
       }
+      return vertex;
     }
 
     /*
-     * The following method print the loop profiling data for each of the functions in the program.
+     * The following method computes a maximum spanning tree (or forest) of a graph with Kruskal's algorithm and returns which of the edges belong to it.
+     * Edges are considered in the order of decreasing weight, and the order of the edges breaks the ties.
      */
-    void printLoopProfilingData(BasicBlock& BB){
-      
-      printString(BB, "\nLOOP PROFILING:\n");
-      for(auto &func: loopMap) {
-        if(func.second.size() > 0) {
-          printString(BB, "\n" + func.first + ":\n");
-          for(auto loop: func.second) {
-            int first = blockIdMap[func.first][*loop.begin()];
-            int last;
-            string loopStr = "";
-            for(auto &b: loop) {
-              loopStr += (b + " ");
-              last = blockIdMap[func.first][b];
-            }
-            printString(BB, loopStr + ": ");
-            printLoopCount(BB, first, last, edgeCounters[func.first]);
-          }
+    vector<bool> computeMaximumSpanningTree(int numVertices, const vector<pair<int, int>> &edges, const vector<double> &weights) {
+
+      vector<int> order;
+      for(unsigned e = 0; e < edges.size(); ++e)
+        order.push_back(e);
+      stable_sort(order.begin(), order.end(), [&](int a, int b) { return weights[a] > weights[b]; });
+
+      vector<int> parent(numVertices);
+      for(int v = 0; v < numVertices; ++v)
+        parent[v] = v;
+      vector<bool> inTree(edges.size(), false);
+      for(auto e: order) {
+        int first = findTreeRoot(parent, edges[e].first);
+        int second = findTreeRoot(parent, edges[e].second);
+        if(first != second) {
+          parent[first] = second;
+          inTree[e] = true;
         }
       }
+      return inTree;
     }
 
     /*
-     * The following method inserts a printf function at the end of the main function 
-     * to display the loop execution count.
+     * The following method returns the number of distinct successors of a basic block.
      */
-    void printLoopCount(BasicBlock& BB, int first, int last, GlobalVariable* edge) {
-
-      IRBuilder<> builder(BB.getTerminator());
-      Constant *format_const;
-      GlobalVariable *PrintfFormatStr;
-      string toPrint = "%d\n";
-      format_const = ConstantDataArray::getString(*Context, toPrint.c_str());
-      PrintfFormatStr = new GlobalVariable(*(BB.getParent()->getParent()), llvm::ArrayType::get(llvm::IntegerType::get(*Context, 8), strlen(toPrint.c_str())+1), true, llvm::GlobalValue::PrivateLinkage, format_const, "PrintfFormatStr");
-      
-      std::vector<Constant*> indices;
-      Constant *zero = Constant::getNullValue(IntegerType::getInt32Ty(*Context));
-      indices.push_back(zero);
-      indices.push_back(zero);
-      Constant *var_ref = ConstantExpr::getGetElementPtr(PrintfFormatStr, indices);
+    unsigned countUniqueSuccessors(BasicBlock *BB) {
 
-      std::vector<Constant*> edgeIndex;
-      ConstantInt* zeroIndex = ConstantInt::get(Type::getInt32Ty(*Context), 0);
-      edgeIndex.push_back(zeroIndex);
+      set<BasicBlock*> successors;
+      TerminatorInst *TI = BB->getTerminator();
+      for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s)
+        successors.insert(TI->getSuccessor(s));
+      return successors.size();
+    }
 
-      ConstantInt* indexFirst = ConstantInt::get(Type::getInt32Ty(*Context), last);
-      edgeIndex.push_back(indexFirst);
+    /*
+     * The following method returns the number of distinct predecessors of a basic block.
+     */
+    unsigned countUniquePredecessors(BasicBlock *BB) {
 
-      ConstantInt* indexSecond = ConstantInt::get(Type::getInt32Ty(*Context), first);
-      edgeIndex.push_back(indexSecond);
+      set<BasicBlock*> preds;
+      for(auto it = pred_begin(BB), end_it = pred_end(BB); it != end_it; ++it)
+        preds.insert(*it);
+      return preds.size();
+    }
 
-      Constant* edgeCountVal = ConstantExpr::getGetElementPtr(edge, edgeIndex);
+    /*
+     * The following method checks whether a counter can be placed on the edge src -> dst. This is possible when the edge is the only way out of
+     * the source or the only way into the destination, or when the edge can be split. Critical edges out of an indirectbr or into a landing pad cannot be split.
+     */
+    bool canInstrumentEdge(BasicBlock *src, BasicBlock *dst) {
 
-      Value *loopCount = builder.CreateLoad(edgeCountVal);
-      CallInst *call = builder.CreateCall2(printf_func, var_ref, loopCount);
-      call->setTailCall(false);
+      if(countUniqueSuccessors(src) == 1 || countUniquePredecessors(dst) == 1)
+        return true;
+      return !isa<IndirectBrInst>(src->getTerminator()) && !dst->isLandingPad();
     }
 
     /*
-     * The following method is used to print the computed dominator set information of a particular function.
+     * The following method returns the instruction before which code must be inserted so that it executes exactly when control flows along the edge src -> dst.
+     * This is the terminator of the source block if the edge is its only way out, the first instruction of the destination block if the edge is its only
+     * way in, and otherwise the terminator of a new block created by splitting the critical edge. The split blocks are remembered so that every kind of
+     * instrumentation placed on the same edge shares one block. Returns NULL if the edge cannot be split.
      */
-    void printDominatorSet(map<string, set<string>> &dominators) {
-      
-      errs() << "\nDominatorSets:\n";
-      for (std::map<string,set<string>>::iterator dominatorIterator=dominators.begin(); dominatorIterator!=dominators.end(); ++dominatorIterator) {
-          errs() << "DomSet[" << dominatorIterator->first << "] => ";
-          for(auto pred : dominatorIterator->second) {
-            errs() << pred << " ";
-          }
-          errs() << "\n";
+    Instruction* getEdgeInsertionPoint(BasicBlock *src, BasicBlock *dst) {
+
+      auto it = edgeBlocks.find(make_pair(src, dst));
+      if(it != edgeBlocks.end())
+        return it->second->getTerminator();
+      if(countUniqueSuccessors(src) == 1)
+        return src->getTerminator();
+      if(countUniquePredecessors(dst) == 1)
+        return &*dst->getFirstInsertionPt();
+
+      TerminatorInst *TI = src->getTerminator();
+      for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+        if(TI->getSuccessor(s) != dst)
+          continue;
+        // All the successor slots of the terminator which lead to dst are redirected to the new block.
+        BasicBlock *edgeBlock = SplitCriticalEdge(TI, s, this, true);
+        if(!edgeBlock)
+          return NULL;
+        edgeBlocks[make_pair(src, dst)] = edgeBlock;
+        return edgeBlock->getTerminator();
       }
-    }    
+      return NULL;
+    }
 
     /*
-     * The following method is used to print the loops inside a particular function.
+     * The following method inserts an increment of a counter which executes exactly when control flows along the edge src -> dst.
      */
-    void printLoops(set<set<string>> &loops) {
+    bool instrumentEdge(BasicBlock *src, BasicBlock *dst, GlobalVariable *counter, int index) {
 
-      if(loops.size() > 0) {
-        errs() << "\nLoops:\n";
-        for(auto loop: loops) {
-          for(auto block: loop) {
-            errs() << block << " ";
-          }
-          errs() << "\n";
-        }
-      }
+      Instruction *insertionPoint = getEdgeInsertionPoint(src, dst);
+      if(!insertionPoint)
+        return false;
+      IRBuilder<> builder(insertionPoint);
+      emitCounterIncrement(builder, counter, index);
+      return true;
     }
 
     /*
-     * The following method inserts a printf function after the last instruction of the basic block
+     * The following method inserts the instructions which increment an element of a one dimensional counter array.
      */
-    void printString(BasicBlock& BB, string toPrint) {
-      
-      IRBuilder<> builder(BB.getTerminator());
-      Constant *format_const;
-      GlobalVariable *PrintfFormatStr;
-      format_const = ConstantDataArray::getString(*Context, toPrint.c_str());
-      PrintfFormatStr = new GlobalVariable(*(BB.getParent()->getParent()), llvm::ArrayType::get(llvm::IntegerType::get(*Context, 8), strlen(toPrint.c_str())+1), true, llvm::GlobalValue::PrivateLinkage, format_const, "PrintfFormatStr");
-      
-      std::vector<Constant*> indices;
-      Constant *zero = Constant::getNullValue(IntegerType::getInt32Ty(*Context));
-      indices.push_back(zero);
+    void emitCounterIncrement(IRBuilder<> &builder, GlobalVariable *counter, int index) {
+
+      emitCounterIncrement(builder, counter, ConstantInt::get(Type::getInt32Ty(*Context), index));
+    }
+
+    /*
+     * The following method inserts the instructions which increment the element of a counter array at a computed index.
+     * With sharded counters the element of the thread local shard of the array is incremented instead.
+     */
+    void emitCounterIncrement(IRBuilder<> &builder, GlobalVariable *counter, Value *index) {
+
+      if(CounterUpdateMode == ShardedCounters)
+        counter = getCounterShard(counter);
+      std::vector<Value*> counterIndex;
+      counterIndex.push_back(ConstantInt::get(index->getType(), 0));
+      counterIndex.push_back(index);
+      Value *counterVal = builder.CreateGEP(counter, counterIndex);
+      Instruction *update = emitIncrement(builder, counterVal, CounterUpdateMode == AtomicCounters);
+      if(isa<Constant>(index))
+        counterUpdates.push_back(make_pair(counterVal, update));
+    }
+
+    /*
+     * The following method inserts the instructions which increment the counter at the given address, using a relaxed atomic add if the counter
+     * is shared between threads. Returns the store or the atomic add.
+     */
+    Instruction* emitIncrement(IRBuilder<> &builder, Value *counterVal, bool atomic) {
+
+      return emitAdd(builder, counterVal, ConstantInt::get(counterVal->getType()->getPointerElementType(), 1), atomic);
+    }
+
+    /*
+     * The following method inserts the instructions which add a value to the counter at the given address, like emitIncrement.
+     * With -saturating-counters a 32 bit counter which would wrap gets its largest value instead. Returns the store or the atomic add.
+     */
+    Instruction* emitAdd(IRBuilder<> &builder, Value *counterVal, Value *value, bool atomic) {
+
+      if(atomic)
+        return builder.CreateAtomicRMW(AtomicRMWInst::Add, counterVal, value, Monotonic);
+      Value *oldCounterVal = builder.CreateLoad(counterVal);
+      Value *addCounter = builder.CreateAdd(oldCounterVal, value);
+      if(SaturatingCounters && value->getType()->isIntegerTy(32))
+        addCounter = builder.CreateSelect(builder.CreateICmpULT(addCounter, oldCounterVal), Constant::getAllOnesValue(value->getType()), addCounter);
+      return builder.CreateStore(addCounter, counterVal);
+    }
+
+    /*
+     * The following method returns the type of the block, edge and path counters.
+     */
+    Type* getCounterType() {
+
+      return SaturatingCounters ? Type::getInt32Ty(*Context) : Type::getInt64Ty(*Context);
+    }
+
+    /*
+     * The following method creates a zero initialized array of n block, edge or path counters, aligned on a cache line so that the counters of
+     * different functions never share one.
+     */
+    GlobalVariable* createCounterArray(Module &M, uint64_t n, Twine name) {
+
+      ArrayType *arrayType = ArrayType::get(getCounterType(), n);
+      GlobalVariable *array = new GlobalVariable(M, arrayType, false, GlobalValue::InternalLinkage, 0, name);
+      array->setInitializer(ConstantAggregateZero::get(arrayType));
+      array->setAlignment(CS201_COUNTER_ALIGNMENT);
+      return array;
+    }
+
+    /*
+     * The following method returns the thread local shard of a counter array, creating it the first time.
+     */
+    GlobalVariable* getCounterShard(GlobalVariable *counter) {
+
+      GlobalVariable *&shard = counterShards[counter];
+      if(!shard) {
+        Type *type = counter->getType()->getPointerElementType();
+        shard = new GlobalVariable(*counter->getParent(), type, false, GlobalValue::InternalLinkage, Constant::getNullValue(type),
+                                   counter->getName() + ".shard", NULL, GlobalVariable::GeneralDynamicTLSModel);
+        shard->setAlignment(counter->getAlignment());
+        shardedCounters.push_back(make_pair(counter, shard));
+      }
+      return shard;
+    }
+
+    /*
+     * The following method inserts a check at the entry of a function which registers the shards of the current thread the first time the thread runs
+     * instrumented code, so that they are merged into the global counters when the thread exits. The check is placed after the allocas of the entry block.
+     */
+    void emitShardRegistration(Function &F) {
+
+      BasicBlock::iterator it = F.getEntryBlock().getFirstInsertionPt();
+      while(isa<AllocaInst>(&*it))
+        ++it;
+      Instruction *splitBefore = &*it;
+      IRBuilder<> builder(splitBefore);
+      Value *registered = builder.CreateLoad(shardRegistered);
+      Value *isNewThread = builder.CreateICmpEQ(registered, ConstantInt::get(Type::getInt8Ty(*Context), 0));
+      MDNode *weights = MDBuilder(*Context).createBranchWeights(1, 1 << 20);
+      TerminatorInst *registerTerm = SplitBlockAndInsertIfThen(isNewThread, splitBefore, false, weights);
+      IRBuilder<> registerBuilder(registerTerm);
+      registerBuilder.CreateCall(registerShardFunc);
+    }
+
+    /*
+     * The following method creates the thread registration support of sharded counters:
+     * - a thread local flag which is set once the thread has registered its shards,
+     * - the function which sets the flag and asks the runtime to merge the shards of the current thread when it exits,
+     * - the function which merges the shards of the current thread into the global counters (its body is generated by createShardFlush).
+     */
+    void createShardRegistration(Module &M) {
+
+      Type *int8Ty = Type::getInt8Ty(*Context);
+      Type *voidTy = Type::getVoidTy(*Context);
+
+      shardRegistered = new GlobalVariable(M, int8Ty, false, GlobalValue::InternalLinkage, ConstantInt::get(int8Ty, 0), "__cs201_shard_registered",
+                                           NULL, GlobalVariable::GeneralDynamicTLSModel);
+      flushShardFunc = Function::Create(FunctionType::get(voidTy, false), GlobalValue::InternalLinkage, "__cs201_flush_shard", &M);
+
+      std::vector<Type*> no_args;
+      Function *registerThread = getLibFunction(M, "__cs201_register_thread", voidTy, no_args);
+      registerShardFunc = Function::Create(FunctionType::get(voidTy, false), GlobalValue::InternalLinkage, "__cs201_register_shard", &M);
+      IRBuilder<> builder(BasicBlock::Create(*Context, "entry", registerShardFunc));
+      builder.CreateStore(ConstantInt::get(int8Ty, 1), shardRegistered);
+      builder.CreateCall(registerThread);
+      builder.CreateRetVoid();
+    }
+
+    /*
+     * The following method generates the body of the function which merges the shards of the current thread into the global counters:
+     *   for every sharded counter array, for(i = 0; i < n; i++) if(shard[i] != 0) { atomic global[i] += shard[i]; shard[i] = 0; }
+     */
+    void createShardFlush() {
+
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      IRBuilder<> builder(BasicBlock::Create(*Context, "entry", flushShardFunc));
+      for(auto &counter: shardedCounters) {
+        uint64_t n = counter.first->getType()->getPointerElementType()->getArrayNumElements();
+        if(n == 0)
+          continue;
+        BasicBlock *preheader = builder.GetInsertBlock();
+        BasicBlock *loop = BasicBlock::Create(*Context, "merge", flushShardFunc);
+        BasicBlock *add = BasicBlock::Create(*Context, "merge.add", flushShardFunc);
+        BasicBlock *next = BasicBlock::Create(*Context, "merge.next", flushShardFunc);
+        BasicBlock *exit = BasicBlock::Create(*Context, "merge.exit", flushShardFunc);
+        builder.CreateBr(loop);
+
+        builder.SetInsertPoint(loop);
+        PHINode *i = builder.CreatePHI(int64Ty, 2, "i");
+        std::vector<Value*> index;
+        index.push_back(ConstantInt::get(int64Ty, 0));
+        index.push_back(i);
+        Value *shardVal = builder.CreateGEP(counter.second, index);
+        Value *globalVal = builder.CreateGEP(counter.first, index);
+        Value *count = builder.CreateLoad(shardVal);
+        builder.CreateCondBr(builder.CreateICmpNE(count, Constant::getNullValue(count->getType())), add, next);
+
+        builder.SetInsertPoint(add);
+        builder.CreateAtomicRMW(AtomicRMWInst::Add, globalVal, count, Monotonic);
+        builder.CreateStore(Constant::getNullValue(count->getType()), shardVal);
+        builder.CreateBr(next);
+
+        builder.SetInsertPoint(next);
+        Value *nextI = builder.CreateAdd(i, ConstantInt::get(int64Ty, 1));
+        builder.CreateCondBr(builder.CreateICmpULT(nextI, ConstantInt::get(int64Ty, n)), loop, exit);
+        i->addIncoming(ConstantInt::get(int64Ty, 0), preheader);
+        i->addIncoming(nextI, next);
+
+        builder.SetInsertPoint(exit);
+      }
+      builder.CreateRetVoid();
+    }
+
+    /*
+     * The following method creates the countdown to the next sample and the sampling interval of the module. The countdown starts at one so that
+     * the first check takes a sample, after which the runtime draws it at random around the interval, so that the samples do not follow the period
+     * of a loop. The runtime sets the interval from the CS201_SAMPLE_INTERVAL environment variable. The countdown is thread local unless the
+     * counters are plain.
+     */
+    void createSamplingCountdown(Module &M) {
+
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      sampleCountdown = new GlobalVariable(M, int32Ty, false, GlobalValue::InternalLinkage, ConstantInt::get(int32Ty, 1), "__cs201_sample_countdown", NULL,
+                                           CounterUpdateMode == PlainCounters ? GlobalVariable::NotThreadLocal : GlobalVariable::GeneralDynamicTLSModel);
+      sampleInterval = new GlobalVariable(M, int32Ty, false, GlobalValue::InternalLinkage, ConstantInt::get(int32Ty, max(1U, (unsigned) SampleInterval)),
+                                          "__cs201_sample_interval");
+      std::vector<Type*> next_sample_arg_types;
+      next_sample_arg_types.push_back(int32Ty);
+      nextSampleFunc = getLibFunction(M, "__cs201_next_sample", int32Ty, next_sample_arg_types);
+    }
+
+    /*
+     * The following method creates the uninstrumented copy of a function used with sampling (the checking code). The original blocks are instrumented
+     * afterwards, and emitSamplingChecks connects the two copies.
+     * 1. The allocas of the entry block are moved to a new entry block, which both copies share.
+     * 2. Every value used outside its block, and every phi node, is demoted to a stack slot in the new entry block, so that a block can move to the
+     *    other copy without the values it uses having to be defined there.
+     * 3. Every block is cloned, the clones branching to each other. The checking code is unreachable until the checks are inserted.
+     * Functions with invokes or indirect branches are not sampled, as demoting the values of an invoke splits edges and the address of a block
+     * cannot be given to both copies.
+     */
+    void createCheckingCode(Function &F, FunctionInfo &info) {
+
+      checkingBlocks.clear();
+      checkingSlots.clear();
+      for(auto *BB: info.blocks) {
+        TerminatorInst *TI = BB->getTerminator();
+        if(isa<InvokeInst>(TI) || isa<IndirectBrInst>(TI) || BB->hasAddressTaken()) {
+          errs() << "Warning: function " << info.name << " cannot be sampled, all its executions are counted\n";
+          return;
+        }
+      }
+
+      BasicBlock *oldEntry = info.blocks[0];
+      BasicBlock *entry = BasicBlock::Create(*Context, "sample.entry", &F, oldEntry);
+      BranchInst *entryBranch = BranchInst::Create(oldEntry, entry);
+      for(auto it = oldEntry->begin(); it != oldEntry->end(); ) {
+        AllocaInst *alloca = dyn_cast<AllocaInst>(&*it++);
+        if(alloca && isa<Constant>(alloca->getArraySize()))
+          alloca->moveBefore(entryBranch);
+      }
+
+      // The phis go first, as the loads which replace them can be used in other blocks as well.
+      vector<PHINode*> phis;
+      for(auto *BB: info.blocks) {
+        for(auto &I: *BB) {
+          if(PHINode *phi = dyn_cast<PHINode>(&I))
+            phis.push_back(phi);
+        }
+      }
+      for(auto *phi: phis)
+        checkingSlots.push_back(DemotePHIToStack(phi, entryBranch));
+      vector<Instruction*> escaping;
+      for(auto *BB: info.blocks) {
+        for(auto &I: *BB) {
+          for(auto *user: I.users()) {
+            if(cast<Instruction>(user)->getParent() != BB) {
+              escaping.push_back(&I);
+              break;
+            }
+          }
+        }
+      }
+      for(auto *I: escaping)
+        checkingSlots.push_back(DemoteRegToStack(*I, false, entryBranch));
+
+      ValueToValueMapTy valueMap;
+      for(auto *BB: info.blocks) {
+        BasicBlock *clone = CloneBasicBlock(BB, valueMap, ".check", &F);
+        valueMap[BB] = clone;
+        checkingBlocks.push_back(clone);
+      }
+      for(auto *clone: checkingBlocks) {
+        for(auto &I: *clone)
+          RemapInstruction(&I, valueMap, RF_IgnoreMissingEntries);
+      }
+      info.sampled = true;
+    }
+
+    /*
+     * The following method connects the checking code of a function to its instrumented code once the instrumentation is in place:
+     * - the entry block checks the countdown and enters the instrumented or the checking copy of the first block,
+     * - every back edge of the checking code checks the countdown and enters the instrumented or the checking copy of the loop header,
+     * - every back edge of the instrumented code goes to the same check, after its counters are updated.
+     * A sampled execution thus runs one acyclic path of the instrumented code, which is also one Ball-Larus path. As every back edge checks the countdown,
+     * one out of every interval iterations of a loop is sampled, so the counters times the interval estimate the counts. The stack slots of the values are
+     * promoted back to registers at the end.
+     */
+    void emitSamplingChecks(Function &F, FunctionInfo &info) {
+
+      BasicBlock *entry = &F.getEntryBlock();
+      entry->getTerminator()->eraseFromParent();
+      IRBuilder<> entryBuilder(entry);
+      emitSampleCheck(entryBuilder, info, 0, checkingBlocks[0], -1);
+
+      for(auto &loop: info.loops) {
+        for(auto latchId: loop.latches) {
+          BasicBlock *latch = info.blocks[latchId];
+          BasicBlock *header = info.blocks[loop.header];
+          BasicBlock *checkingLatch = checkingBlocks[latchId];
+          BasicBlock *checkingHeader = checkingBlocks[loop.header];
+
+          BasicBlock *check = BasicBlock::Create(*Context, "sample.check", &F);
+          TerminatorInst *TI = checkingLatch->getTerminator();
+          for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+            if(TI->getSuccessor(s) == checkingHeader)
+              TI->setSuccessor(s, check);
+          }
+          IRBuilder<> builder(check);
+          emitSampleCheck(builder, info, loop.header, checkingHeader, loop.header);
+
+          // The counters of the back edge are either at the end of the latch or in the block which splits the edge.
+          auto it = edgeBlocks.find(make_pair(latch, header));
+          TI = (it != edgeBlocks.end() ? it->second : latch)->getTerminator();
+          for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+            if(TI->getSuccessor(s) == header)
+              TI->setSuccessor(s, check);
+          }
+        }
+      }
+
+      vector<AllocaInst*> promotable;
+      for(auto *slot: checkingSlots) {
+        if(isAllocaPromotable(slot))
+          promotable.push_back(slot);
+      }
+      DominatorTree DT;
+      DT.recalculate(F);
+      PromoteMemToReg(promotable, DT);
+    }
+
+    /*
+     * The following method inserts a check of the sampling countdown at the end of a block, which branches to the instrumented copy of a block
+     * when the countdown runs out and to its checking copy otherwise. A sample draws the next countdown from the runtime, and sets the path
+     * register first if it starts at a loop header.
+     *   if(--countdown == 0) { countdown = __cs201_next_sample(interval); goto instrumented; } else goto checking;
+     */
+    void emitSampleCheck(IRBuilder<> &builder, FunctionInfo &info, int block, BasicBlock *checking, int header) {
+
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Value *countdown = builder.CreateSub(builder.CreateLoad(sampleCountdown), ConstantInt::get(int32Ty, 1));
+      builder.CreateStore(countdown, sampleCountdown);
+      Value *sample = builder.CreateICmpEQ(countdown, ConstantInt::get(int32Ty, 0));
+
+      BasicBlock *enter = BasicBlock::Create(*Context, "sample.enter", builder.GetInsertBlock()->getParent());
+      IRBuilder<> enterBuilder(enter);
+      enterBuilder.CreateStore(enterBuilder.CreateCall(nextSampleFunc, enterBuilder.CreateLoad(sampleInterval)), sampleCountdown);
+      if(header >= 0 && info.paths.pathRegister && info.paths.headerStarts.count(header))
+        enterBuilder.CreateStore(ConstantInt::get(Type::getInt64Ty(*Context), info.paths.headerStarts[header]), info.paths.pathRegister);
+      enterBuilder.CreateBr(info.blocks[block]);
+
+      MDNode *weights = MDBuilder(*Context).createBranchWeights(1, max(2U, (unsigned) SampleInterval) - 1);
+      builder.CreateCondBr(sample, enter, checking, weights);
+    }
+
+    /*
+     * The following method implements the spanning tree counter placement for a function.
+     * 1. The CFG is extended with a virtual exit block, an edge to it from every block without successors and an edge from it to the entry block.
+     * 2. A maximum spanning tree is computed using the estimated edge frequencies. The virtual edge to the entry block cannot be counted, so it
+     *    is added to the tree first, followed by the edges which cannot be instrumented.
+     * 3. Every edge which is not part of the tree (chord) gets its own counter in the chordCounter_<function> array.
+     * 4. The counts of the tree edges are computed from the chord counters using flow conservation: whenever all but one of the edges incident on a block
+     *    are known, the remaining one is the difference between the known inflow and outflow. The block counts are then the sums of their incoming edges.
+     */
+    void instrumentSpanningTreeChords(Function &F, FunctionInfo &info) {
+
+      // The vertex of the virtual exit block is numBlocks. The flow edges are the CFG edges, the edges to the exit block and the virtual edge.
+      int numBlocks = info.blocks.size();
+      int exitVertex = numBlocks;
+      int numEdges = info.edges.size();
+      vector<pair<int, int>> flowEdges = info.edges;
+      vector<double> flowWeights;
+      for(int e = 0; e < numEdges; ++e) {
+        if(!canInstrumentEdge(info.blocks[info.edges[e].first], info.blocks[info.edges[e].second]))
+          flowWeights.push_back(DBL_MAX);
+        else
+          flowWeights.push_back(info.edgeWeights[e]);
+      }
+      for(int v = 0; v < numBlocks; ++v) {
+        if(info.successors[v].empty()) {
+          flowEdges.push_back(make_pair(v, exitVertex));
+          flowWeights.push_back(info.exitWeights[v]);
+        }
+      }
+      flowEdges.push_back(make_pair(exitVertex, 0));
+      flowWeights.push_back(HUGE_VAL);
+
+      vector<bool> inTree = computeMaximumSpanningTree(numBlocks + 1, flowEdges, flowWeights);
+      auto nameOf = [&](int v) { return v == exitVertex ? string("") : info.blocks[v]->getName().str(); };
+
+      // Every chord gets a counter. The counters of the edges to the exit block go before the terminator of the exiting block.
+      vector<CounterExpr> flowCounts(flowEdges.size());
+      vector<bool> known(flowEdges.size(), false);
+      vector<int> chords;
+      for(unsigned e = 0; e < flowEdges.size(); ++e) {
+        if(!inTree[e])
+          chords.push_back(e);
+      }
+      GlobalVariable *chordCounter = createCounterArray(*F.getParent(), chords.size(), "chordCounter_" + info.name);
+      info.counters = chordCounter;
+
+      for(unsigned c = 0; c < chords.size(); ++c) {
+        auto &edge = flowEdges[chords[c]];
+        bool instrumented;
+        if(edge.second == exitVertex) {
+          IRBuilder<> builder(info.blocks[edge.first]->getTerminator());
+          emitCounterIncrement(builder, chordCounter, c);
+          instrumented = true;
+        } else {
+          instrumented = instrumentEdge(info.blocks[edge.first], info.blocks[edge.second], chordCounter, c);
+        }
+        if(instrumented) {
+          flowCounts[chords[c]][make_pair(EdgeCounters, (int) c)] = 1;
+          known[chords[c]] = true;
+        } else {
+          errs() << "Warning: cannot place a counter on the edge " << nameOf(edge.first) << " -> " << nameOf(edge.second) << "\n";
+        }
+      }
+      if(Verbosity >= 1)
+        errs() << "\nSpanning tree counters: " << chords.size() << " chords out of " << flowEdges.size() << " edges\n";
+
+      // Here we solve the flow conservation equations of the vertices until no tree edge can be computed any more. A vertex is checked again
+      // whenever one of its edges becomes known.
+      vector<vector<int>> incident(numBlocks + 1);
+      for(unsigned e = 0; e < flowEdges.size(); ++e) {
+        incident[flowEdges[e].first].push_back(e);
+        if(flowEdges[e].first != flowEdges[e].second)
+          incident[flowEdges[e].second].push_back(e);
+      }
+      vector<int> worklist;
+      for(int v = numBlocks; v >= 0; --v)
+        worklist.push_back(v);
+      while(!worklist.empty()) {
+        int v = worklist.back();
+        worklist.pop_back();
+        int unknown = -1, numUnknown = 0;
+        for(auto e: incident[v]) {
+          if(!known[e]) {
+            unknown = e;
+            numUnknown++;
+          }
+        }
+        if(numUnknown != 1 || flowEdges[unknown].first == flowEdges[unknown].second)
+          continue;
+        // The unknown edge is equal to (inflow - outflow) of the known edges if it leaves v, and to (outflow - inflow) if it enters v.
+        int sign = flowEdges[unknown].first == v ? 1 : -1;
+        CounterExpr count;
+        for(auto e: incident[v]) {
+          if(e == unknown || flowEdges[e].first == flowEdges[e].second)
+            continue;
+          int direction = flowEdges[e].second == v ? 1 : -1;
+          for(auto &term: flowCounts[e])
+            count[term.first] += sign * direction * term.second;
+        }
+        for(auto it = count.begin(); it != count.end(); ) {
+          if(it->second == 0)
+            it = count.erase(it);
+          else
+            ++it;
+        }
+        flowCounts[unknown] = count;
+        known[unknown] = true;
+        worklist.push_back(flowEdges[unknown].first == v ? flowEdges[unknown].second : flowEdges[unknown].first);
+      }
+
+      info.blockCounts.assign(numBlocks, CounterExpr());
+      info.edgeCounts.assign(numEdges, CounterExpr());
+      for(unsigned e = 0; e < flowEdges.size(); ++e) {
+        auto &edge = flowEdges[e];
+        if(!known[e]) {
+          errs() << "Warning: cannot compute the count of the edge " << nameOf(edge.first) << " -> " << nameOf(edge.second) << "\n";
+          continue;
+        }
+        if((int) e < numEdges)
+          info.edgeCounts[e] = flowCounts[e];
+        if(edge.second != exitVertex) {
+          CounterExpr &blockCount = info.blockCounts[edge.second];
+          for(auto &term: flowCounts[e])
+            blockCount[term.first] += term.second;
+        }
+      }
+    }
+
+    /*
+     * The following method implements Ball-Larus path profiling for a function.
+     * 1. The CFG is turned into a DAG with a single exit: every back edge latch -> header is replaced by the dummy edges entry -> header and latch -> exit,
+     *    and every block without successors gets an edge to the virtual exit block. Back edges are the ones found by populateLoopInfomation, together with any
+     *    edge which still closes a cycle (irreducible loops).
+     * 2. Every edge e = v -> w gets a value such that the sum of the values along every entry -> exit path of the DAG is a unique number in [0, NumPaths(entry)).
+     *    Val(e) is the number of paths from v which use the edges of v preceding e, so NumPaths(v) is the sum of NumPaths(w) over the edges of v.
+     * 3. The increments are moved to the chords of a maximum spanning tree of the DAG (extended with the edge exit -> entry). If the potential of every vertex
+     *    is chosen so that Val(e) = potential(w) - potential(v) on the tree edges, then Inc(e) = Val(e) + potential(v) - potential(w) is zero on every tree edge
+     *    and the increments along every path still sum to its path number.
+     * 4. A path register is cleared at the entry of the function and incremented on the chords. The path counter is incremented when the path ends at a
+     *    block without successors or at a back edge, after which the register is set to the increment of the dummy entry edge of the loop header.
+     * Functions with at most -path-profile-dense-limit paths get one counter per path, and the others a hash table keyed by the path number.
+     */
+    void instrumentPaths(Function &F, FunctionInfo &info) {
+
+      string funcName = info.name;
+      int numBlocks = info.blocks.size();
+      int exitVertex = numBlocks;
+      vector<BasicBlock*> &blockById = info.blocks;
+      vector<vector<int>> &successors = info.successors;
+      int entryVertex = 0;
+
+      // A depth first search from the entry block finds the edges which close a cycle when the back edges are removed.
+      set<pair<int, int>> backEdges;
+      for(auto &loop: info.loops) {
+        for(auto latch: loop.latches)
+          backEdges.insert(make_pair(latch, loop.header));
+      }
+      vector<int> state(numBlocks, 0);
+      vector<pair<int, unsigned>> dfsStack;
+      dfsStack.push_back(make_pair(entryVertex, 0));
+      state[entryVertex] = 1;
+      while(!dfsStack.empty()) {
+        int v = dfsStack.back().first;
+        unsigned next = dfsStack.back().second++;
+        if(next == successors[v].size()) {
+          state[v] = 2;
+          dfsStack.pop_back();
+          continue;
+        }
+        int w = successors[v][next];
+        if(backEdges.count(make_pair(v, w)))
+          continue;
+        if(state[w] == 1) {
+          backEdges.insert(make_pair(v, w));
+        } else if(state[w] == 0) {
+          state[w] = 1;
+          dfsStack.push_back(make_pair(w, 0));
+        }
+      }
+
+      // Here we build the edges of the DAG for the blocks reachable from the entry block.
+      vector<PathEdge> pathEdges;
+      vector<vector<int>> outEdges(numBlocks + 1);
+      map<int, int> entryDummies, exitDummies;
+      auto addPathEdge = [&](int src, int dst, int kind) {
+        PathEdge edge;
+        edge.src = src;
+        edge.dst = dst;
+        edge.kind = kind;
+        pathEdges.push_back(edge);
+        outEdges[src].push_back(pathEdges.size() - 1);
+        return (int) pathEdges.size() - 1;
+      };
+      for(int v = 0; v < numBlocks; ++v) {
+        if(state[v] == 0)
+          continue;
+        if(successors[v].empty())
+          addPathEdge(v, exitVertex, ExitEdge);
+        for(auto w: successors[v]) {
+          if(!backEdges.count(make_pair(v, w))) {
+            addPathEdge(v, w, RealEdge);
+            continue;
+          }
+          if(!exitDummies.count(v))
+            exitDummies[v] = addPathEdge(v, exitVertex, ExitDummyEdge);
+          if(!entryDummies.count(w))
+            entryDummies[w] = addPathEdge(entryVertex, w, EntryDummyEdge);
+        }
+      }
+
+      // The DAG is numbered in reverse topological order, i.e. in the post order of a depth first search from the entry block.
+      vector<int> postOrder;
+      vector<bool> visited(numBlocks + 1, false);
+      vector<pair<int, unsigned>> topoStack;
+      topoStack.push_back(make_pair(entryVertex, 0));
+      visited[entryVertex] = true;
+      while(!topoStack.empty()) {
+        int v = topoStack.back().first;
+        unsigned next = topoStack.back().second++;
+        if(next == outEdges[v].size()) {
+          postOrder.push_back(v);
+          topoStack.pop_back();
+          continue;
+        }
+        int w = pathEdges[outEdges[v][next]].dst;
+        if(!visited[w]) {
+          visited[w] = true;
+          topoStack.push_back(make_pair(w, 0));
+        }
+      }
+
+      const uint64_t maxPaths = 1ULL << 62;
+      vector<uint64_t> numPaths(numBlocks + 1, 0);
+      for(auto v: postOrder) {
+        if(v == exitVertex) {
+          numPaths[v] = 1;
+          continue;
+        }
+        for(auto e: outEdges[v]) {
+          pathEdges[e].val = numPaths[v];
+          numPaths[v] += numPaths[pathEdges[e].dst];
+          if(numPaths[v] > maxPaths) {
+            errs() << "Warning: too many paths in function " << funcName << ", it is not path profiled\n";
+            return;
+          }
+        }
+      }
+      uint64_t totalPaths = numPaths[entryVertex];
+      if(Verbosity >= 1)
+        errs() << "\nPaths: " << totalPaths << "\n";
+
+      // Every back edge has to be instrumented, the other edges which cannot be instrumented are kept in the spanning tree.
+      for(auto &edge: backEdges) {
+        if(state[edge.first] != 0 && !canInstrumentEdge(blockById[edge.first], blockById[edge.second])) {
+          errs() << "Warning: cannot instrument the back edge " << blockById[edge.first]->getName() << " -> " << blockById[edge.second]->getName()
+                 << ", function " << funcName << " is not path profiled\n";
+          return;
+        }
+      }
+      // The dummy edges are as frequent as the back edges they stand for.
+      vector<double> latchWeights(numBlocks, 0), headerWeights(numBlocks, 0);
+      for(auto &backEdge: backEdges) {
+        double weight = info.edgeWeights[findEdge(info, backEdge.first, backEdge.second)];
+        latchWeights[backEdge.first] += weight;
+        headerWeights[backEdge.second] += weight;
+      }
+      vector<pair<int, int>> treeEdges;
+      vector<double> treeWeights;
+      for(auto &edge: pathEdges) {
+        treeEdges.push_back(make_pair(edge.src, edge.dst));
+        if(edge.kind == RealEdge) {
+          if(!canInstrumentEdge(blockById[edge.src], blockById[edge.dst]))
+            treeWeights.push_back(DBL_MAX);
+          else
+            treeWeights.push_back(info.edgeWeights[findEdge(info, edge.src, edge.dst)]);
+        } else if(edge.kind == ExitEdge) {
+          treeWeights.push_back(info.exitWeights[edge.src]);
+        } else if(edge.kind == ExitDummyEdge) {
+          treeWeights.push_back(latchWeights[edge.src]);
+        } else {
+          treeWeights.push_back(headerWeights[edge.dst]);
+        }
+      }
+      treeEdges.push_back(make_pair(exitVertex, entryVertex));
+      treeWeights.push_back(HUGE_VAL);
+      vector<bool> inTree = computeMaximumSpanningTree(numBlocks + 1, treeEdges, treeWeights);
+
+      // Here we compute the potentials of the vertices by walking the tree from the exit vertex, and the increments of the chords from them.
+      // The arithmetic wraps around, which is harmless as the increments along every path still add up to its path number.
+      vector<vector<int>> treeAdjacency(numBlocks + 1);
+      for(unsigned e = 0; e < pathEdges.size(); ++e) {
+        if(inTree[e]) {
+          treeAdjacency[pathEdges[e].src].push_back(e);
+          treeAdjacency[pathEdges[e].dst].push_back(e);
+        }
+      }
+      vector<uint64_t> potential(numBlocks + 1, 0);
+      vector<bool> reached(numBlocks + 1, false);
+      stack<int> treeStack;
+      // The edge exit -> entry has value zero, so both end points have the same potential.
+      reached[exitVertex] = reached[entryVertex] = true;
+      treeStack.push(exitVertex);
+      treeStack.push(entryVertex);
+      while(!treeStack.empty()) {
+        int v = treeStack.top();
+        treeStack.pop();
+        for(auto e: treeAdjacency[v]) {
+          PathEdge &edge = pathEdges[e];
+          int w = edge.src == v ? edge.dst : edge.src;
+          if(reached[w])
+            continue;
+          potential[w] = edge.src == v ? potential[v] + edge.val : potential[v] - edge.val;
+          reached[w] = true;
+          treeStack.push(w);
+        }
+      }
+      for(unsigned e = 0; e < pathEdges.size(); ++e) {
+        PathEdge &edge = pathEdges[e];
+        edge.inc = inTree[e] ? 0 : edge.val + potential[edge.src] - potential[edge.dst];
+        if(edge.kind == RealEdge && edge.inc != 0 && !canInstrumentEdge(blockById[edge.src], blockById[edge.dst])) {
+          errs() << "Warning: cannot instrument the edge " << blockById[edge.src]->getName() << " -> " << blockById[edge.dst]->getName()
+                 << ", function " << funcName << " is not path profiled\n";
+          return;
+        }
+      }
+
+      // Here we create the path counters.
+      Module &M = *F.getParent();
+      PathProfileInfo paths;
+      paths.numPaths = totalPaths;
+      paths.dense = totalPaths <= PathProfileDenseLimit;
+      paths.tableSize = NextPowerOf2(max(1U, (unsigned) PathProfileTableSize) - 1);
+      uint64_t numCounters = paths.dense ? totalPaths : paths.tableSize;
+      paths.counters = createCounterArray(M, numCounters, "pathCounter_" + funcName);
+      if(paths.dense) {
+        // The names of the paths are decoded at compile time by following the edge with the largest value not above the remaining path number.
+        vector<Constant*> names;
+        Constant *zero = Constant::getNullValue(IntegerType::getInt32Ty(*Context));
+        vector<Constant*> indices;
+        indices.push_back(zero);
+        indices.push_back(zero);
+        for(uint64_t path = 0; path < totalPaths; ++path) {
+          uint64_t remaining = path;
+          int v = entryVertex;
+          string pathStr = "";
+          while(v != exitVertex) {
+            int chosen = -1;
+            for(auto e: outEdges[v]) {
+              if(pathEdges[e].val <= remaining)
+                chosen = e;
+            }
+            PathEdge &edge = pathEdges[chosen];
+            remaining -= edge.val;
+            if(edge.kind == EntryDummyEdge)
+              pathStr = blockById[edge.dst]->getName();
+            else if(edge.kind == RealEdge)
+              pathStr += (pathStr.empty() ? blockById[v]->getName().str() : "") + " -> " + blockById[edge.dst]->getName().str();
+            else if(pathStr.empty())
+              pathStr = blockById[v]->getName();
+            v = edge.dst;
+          }
+          Constant *name_const = ConstantDataArray::getString(*Context, pathStr.c_str());
+          GlobalVariable *nameStr = new GlobalVariable(M, name_const->getType(), true, GlobalValue::PrivateLinkage, name_const, "PathNameStr");
+          names.push_back(ConstantExpr::getGetElementPtr(nameStr, indices));
+        }
+        ArrayType *namesType = ArrayType::get(Type::getInt8PtrTy(*Context), totalPaths);
+        paths.names = new GlobalVariable(M, namesType, true, GlobalValue::PrivateLinkage, ConstantArray::get(namesType, names), "pathNames_" + funcName);
+      } else {
+        ArrayType *keyArrayType = ArrayType::get(IntegerType::get(*Context, 64), paths.tableSize);
+        paths.keys = new GlobalVariable(M, keyArrayType, false, GlobalValue::InternalLinkage, 0, "pathKeys_" + funcName);
+        paths.keys->setInitializer(ConstantAggregateZero::get(keyArrayType));
+        paths.overflow = new GlobalVariable(M, getCounterType(), false, GlobalValue::InternalLinkage, 0, "pathOverflow_" + funcName);
+        paths.overflow->setInitializer(ConstantInt::get(getCounterType(), 0));
+      }
+      info.paths = paths;
+
+      // Here we insert the path register and its updates.
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      AllocaInst *pathRegister = entryBuilder.CreateAlloca(Type::getInt64Ty(*Context), 0, "pathRegister");
+      entryBuilder.CreateStore(ConstantInt::get(Type::getInt64Ty(*Context), 0), pathRegister);
+
+      for(auto &edge: pathEdges) {
+        if(edge.kind == RealEdge && edge.inc != 0) {
+          IRBuilder<> builder(getEdgeInsertionPoint(blockById[edge.src], blockById[edge.dst]));
+          Value *path = builder.CreateLoad(pathRegister);
+          builder.CreateStore(builder.CreateAdd(path, ConstantInt::get(Type::getInt64Ty(*Context), edge.inc)), pathRegister);
+        } else if(edge.kind == ExitEdge) {
+          IRBuilder<> builder(blockById[edge.src]->getTerminator());
+          emitPathCountIncrement(builder, paths, pathRegister, edge.inc);
+        }
+      }
+      for(auto &backEdge: backEdges) {
+        if(state[backEdge.first] == 0)
+          continue;
+        IRBuilder<> builder(getEdgeInsertionPoint(blockById[backEdge.first], blockById[backEdge.second]));
+        emitPathCountIncrement(builder, paths, pathRegister, pathEdges[exitDummies[backEdge.first]].inc);
+        builder.CreateStore(ConstantInt::get(Type::getInt64Ty(*Context), pathEdges[entryDummies[backEdge.second]].inc), pathRegister);
+      }
+      info.paths.pathRegister = pathRegister;
+      for(auto &entryDummy: entryDummies)
+        info.paths.headerStarts[entryDummy.first] = pathEdges[entryDummy.second].inc;
+    }
+
+    /*
+     * The following method counts the trip counts of the loops of a function in a histogram with TripCountBuckets power of two buckets per loop.
+     * Every loop gets a trip count register which is cleared on the edges entering its header from outside the loop and incremented on its back edges.
+     * When the loop is left, through an edge to a block outside the loop or at a block without successors inside it, the bucket of the trip count
+     * (the number of header executions since the entry) is incremented:
+     *   trip = tripRegister + 1; histogram[loop * TripCountBuckets + min(63 - ctlz(trip), TripCountBuckets - 1)]++
+     * A loop whose entry or exit edges cannot be instrumented gets no histogram. Sampled functions get none either, as a sample never runs more
+     * than one iteration of a loop.
+     */
+    void instrumentLoops(Function &F, FunctionInfo &info) {
+
+      if(info.loops.empty() || info.sampled || Coverage)
+        return;
+
+      vector<vector<pair<int, int>>> entryEdges(info.loops.size()), exitEdges(info.loops.size());
+      vector<vector<int>> exitBlocks(info.loops.size());
+      vector<bool> counted(info.loops.size(), true);
+      for(unsigned l = 0; l < info.loops.size(); ++l) {
+        NaturalLoop &loop = info.loops[l];
+        counted[l] = getLoopEdges(info, l, entryEdges[l], exitEdges[l]);
+        for(auto block: loop.blocks) {
+          if(info.successors[block].empty())
+            exitBlocks[l].push_back(block);
+        }
+        if(!counted[l])
+          errs() << "Warning: cannot count the trip counts of the loop at " << info.blocks[loop.header]->getName() << "\n";
+      }
+
+      ArrayType *histogramType = ArrayType::get(Type::getInt64Ty(*Context), info.loops.size() * TripCountBuckets);
+      info.loopHistogram = new GlobalVariable(*F.getParent(), histogramType, false, GlobalValue::InternalLinkage, 0, "loopHistogram_" + info.name);
+      info.loopHistogram->setInitializer(ConstantAggregateZero::get(histogramType));
+
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      for(unsigned l = 0; l < info.loops.size(); ++l) {
+        if(!counted[l])
+          continue;
+        NaturalLoop &loop = info.loops[l];
+        AllocaInst *tripRegister = entryBuilder.CreateAlloca(int64Ty, 0, "tripRegister");
+        for(auto &edge: entryEdges[l]) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          builder.CreateStore(ConstantInt::get(int64Ty, 0), tripRegister);
+        }
+        for(auto latch: loop.latches) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[latch], info.blocks[loop.header]));
+          builder.CreateStore(builder.CreateAdd(builder.CreateLoad(tripRegister), ConstantInt::get(int64Ty, 1)), tripRegister);
+        }
+        for(auto &edge: exitEdges[l]) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          emitTripCountIncrement(builder, info, l, tripRegister);
+        }
+        for(auto block: exitBlocks[l]) {
+          IRBuilder<> builder(info.blocks[block]->getTerminator());
+          emitTripCountIncrement(builder, info, l, tripRegister);
+        }
+      }
+    }
+
+    /*
+     * The following method inserts the coverage flags of a function: the flag of a block at its start and the flag of an edge on the edge, like the
+     * counters of instrumentEdges. A flag is only stored when it is not set yet, so that once the code is covered it only reads its flags and the
+     * cache lines of the flags stay shared between the cores:
+     *   if(!coverage[v]) coverage[v] = 1
+     * An edge which cannot be instrumented is flagged at the start of its destination, so it is reported covered when its destination ran. The counter
+     * expressions of the blocks and edges are left empty, as there are no counts.
+     */
+    void instrumentCoverage(Function &F, FunctionInfo &info) {
+
+      int numBlocks = info.blocks.size();
+      info.blockCounts.assign(numBlocks, CounterExpr());
+      info.edgeCounts.assign(info.edges.size(), CounterExpr());
+
+      // The insertion points are all found before the flag checks split the blocks.
+      vector<Instruction*> insertionPoints;
+      for(auto *BB: info.blocks)
+        insertionPoints.push_back(&*BB->getFirstInsertionPt());
+      for(auto &edge: info.edges) {
+        BasicBlock *src = info.blocks[edge.first], *dst = info.blocks[edge.second];
+        insertionPoints.push_back(canInstrumentEdge(src, dst) ? getEdgeInsertionPoint(src, dst) : &*dst->getFirstInsertionPt());
+      }
+
+      Type *int8Ty = Type::getInt8Ty(*Context);
+      MDNode *weights = MDBuilder(*Context).createBranchWeights(1, 1 << 20);
+      for(unsigned i = 0; i < insertionPoints.size(); ++i) {
+        IRBuilder<> builder(insertionPoints[i]);
+        Value *flag = builder.CreateConstGEP2_32(info.coverage, 0, i);
+        Value *unset = builder.CreateICmpEQ(builder.CreateLoad(flag), ConstantInt::get(int8Ty, 0));
+        TerminatorInst *setTerm = SplitBlockAndInsertIfThen(unset, insertionPoints[i], false, weights);
+        IRBuilder<> setBuilder(setTerm);
+        setBuilder.CreateStore(ConstantInt::get(int8Ty, 1), flag);
+      }
+    }
+
+    /*
+     * The following method finds the edges into the header of a loop from outside the loop and the edges leaving the loop. Returns false if one of
+     * them cannot be instrumented.
+     */
+    bool getLoopEdges(FunctionInfo &info, int l, vector<pair<int, int>> &entryEdges, vector<pair<int, int>> &exitEdges) {
+
+      NaturalLoop &loop = info.loops[l];
+      BitVector inLoop(info.blocks.size());
+      for(auto block: loop.blocks)
+        inLoop.set(block);
+      bool instrumentable = true;
+      for(auto &edge: info.edges) {
+        if(edge.second == loop.header && !inLoop.test(edge.first))
+          entryEdges.push_back(edge);
+        else if(inLoop.test(edge.first) && !inLoop.test(edge.second))
+          exitEdges.push_back(edge);
+        else
+          continue;
+        instrumentable = instrumentable && canInstrumentEdge(info.blocks[edge.first], info.blocks[edge.second]);
+      }
+      return instrumentable;
+    }
+
+    /*
+     * The following method inserts the instructions which increment the trip count histogram bucket of the trip count of a loop.
+     */
+    void emitTripCountIncrement(IRBuilder<> &builder, FunctionInfo &info, int loop, Value *tripRegister) {
+
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      Value *trip = builder.CreateAdd(builder.CreateLoad(tripRegister), ConstantInt::get(int64Ty, 1));
+      std::vector<Type*> ctlzTypes;
+      ctlzTypes.push_back(int64Ty);
+      Function *ctlz = Intrinsic::getDeclaration(builder.GetInsertBlock()->getParent()->getParent(), Intrinsic::ctlz, ctlzTypes);
+      Value *bucket = builder.CreateSub(ConstantInt::get(int64Ty, 63), builder.CreateCall2(ctlz, trip, builder.getTrue()));
+      Value *lastBucket = ConstantInt::get(int64Ty, TripCountBuckets - 1);
+      bucket = builder.CreateSelect(builder.CreateICmpUGT(bucket, lastBucket), lastBucket, bucket);
+      emitCounterIncrement(builder, info.loopHistogram, builder.CreateAdd(bucket, ConstantInt::get(int64Ty, loop * TripCountBuckets)));
+    }
+
+    /*
+     * The following method inserts the stride profiling of the loads and stores made inside loops. Every site keeps its previous address, its
+     * previous stride and its state (no address yet, one address, one stride) in local variables, which are promoted to registers, and its state is
+     * cleared on the entry edges of the innermost loop containing it, so that the strides are the ones between consecutive iterations of that loop.
+     * Every access increments the counter of its stride class (see CS201_STRIDE_CLASSES):
+     *   stride = address - previousAddress
+     *   class = state == 0 ? first : state == 2 && stride == previousStride ? constant : |stride| <= CS201_SMALL_STRIDE ? small : irregular
+     * and the exit edges of the loop store the last stride of every site which has one, to be printed along with its counts. The sites of a loop
+     * with an entry or exit edge which cannot be instrumented are not profiled.
+     */
+    void instrumentMemoryAccesses(Function &F, FunctionInfo &info) {
+
+      // The sites are grouped by innermost loop, the one with the fewest blocks which contains them.
+      map<int, vector<int>> loopSites;
+      vector<MemorySite> sites;
+      for(auto &site: info.memorySites) {
+        int innermost = -1;
+        for(unsigned l = 0; l < info.loops.size(); ++l) {
+          vector<int> &blocks = info.loops[l].blocks;
+          if(binary_search(blocks.begin(), blocks.end(), site.block) && (innermost < 0 || blocks.size() < info.loops[innermost].blocks.size()))
+            innermost = l;
+        }
+        vector<pair<int, int>> entryEdges, exitEdges;
+        if(innermost < 0 || (!loopSites.count(innermost) && !getLoopEdges(info, innermost, entryEdges, exitEdges)))
+          continue;
+        loopSites[innermost].push_back(sites.size());
+        sites.push_back(site);
+      }
+      info.memorySites = sites;
+      if(sites.empty())
+        return;
+
+      Module &M = *F.getParent();
+      Type *int8Ty = Type::getInt8Ty(*Context);
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      ArrayType *countersType = ArrayType::get(Type::getInt64Ty(*Context), sites.size() * CS201_STRIDE_CLASSES);
+      info.strideCounters = new GlobalVariable(M, countersType, false, GlobalValue::InternalLinkage, 0, "strideCounters_" + info.name);
+      info.strideCounters->setInitializer(ConstantAggregateZero::get(countersType));
+      ArrayType *stridesType = ArrayType::get(int64Ty, sites.size());
+      info.strides = new GlobalVariable(M, stridesType, false, GlobalValue::InternalLinkage, 0, "strides_" + info.name);
+      info.strides->setInitializer(ConstantAggregateZero::get(stridesType));
+
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      for(auto &loop: loopSites) {
+        vector<pair<int, int>> entryEdges, exitEdges;
+        getLoopEdges(info, loop.first, entryEdges, exitEdges);
+        vector<AllocaInst*> addressSlots, strideSlots, stateSlots;
+        for(auto i: loop.second) {
+          addressSlots.push_back(entryBuilder.CreateAlloca(int64Ty, 0, "previousAddress"));
+          strideSlots.push_back(entryBuilder.CreateAlloca(int64Ty, 0, "previousStride"));
+          stateSlots.push_back(entryBuilder.CreateAlloca(int8Ty, 0, "strideState"));
+
+          IRBuilder<> builder(sites[i].access);
+          Value *address = builder.CreatePtrToInt(sites[i].pointer, int64Ty);
+          Value *stride = builder.CreateSub(address, builder.CreateLoad(addressSlots.back()));
+          Value *state = builder.CreateLoad(stateSlots.back());
+          Value *constant = builder.CreateAnd(builder.CreateICmpEQ(state, ConstantInt::get(int8Ty, 2)),
+                                              builder.CreateICmpEQ(stride, builder.CreateLoad(strideSlots.back())));
+          Value *size = builder.CreateSelect(builder.CreateICmpSLT(stride, ConstantInt::get(int64Ty, 0)), builder.CreateNeg(stride), stride);
+          Value *strideClass = builder.CreateSelect(builder.CreateICmpULE(size, ConstantInt::get(int64Ty, CS201_SMALL_STRIDE)),
+                                                    ConstantInt::get(int64Ty, CS201_STRIDE_SMALL), ConstantInt::get(int64Ty, CS201_STRIDE_IRREGULAR));
+          strideClass = builder.CreateSelect(constant, ConstantInt::get(int64Ty, CS201_STRIDE_CONSTANT), strideClass);
+          Value *first = builder.CreateICmpEQ(state, ConstantInt::get(int8Ty, 0));
+          strideClass = builder.CreateSelect(first, ConstantInt::get(int64Ty, CS201_STRIDE_FIRST), strideClass);
+          emitCounterIncrement(builder, info.strideCounters, builder.CreateAdd(strideClass, ConstantInt::get(int64Ty, i * CS201_STRIDE_CLASSES)));
+          builder.CreateStore(address, addressSlots.back());
+          builder.CreateStore(stride, strideSlots.back());
+          builder.CreateStore(builder.CreateSelect(first, ConstantInt::get(int8Ty, 1), ConstantInt::get(int8Ty, 2)), stateSlots.back());
+        }
+        for(auto &edge: entryEdges) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          for(auto *slot: stateSlots)
+            builder.CreateStore(ConstantInt::get(int8Ty, 0), slot);
+        }
+        for(auto &edge: exitEdges) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          for(unsigned s = 0; s < loop.second.size(); ++s) {
+            Value *last = builder.CreateConstGEP2_32(info.strides, 0, loop.second[s]);
+            Value *hasStride = builder.CreateICmpEQ(builder.CreateLoad(stateSlots[s]), ConstantInt::get(int8Ty, 2));
+            builder.CreateStore(builder.CreateSelect(hasStride, builder.CreateLoad(strideSlots[s]), builder.CreateLoad(last)), last);
+          }
+        }
+      }
+    }
+
+    /*
+     * The following method inserts the value profiling of a function. The value of every site is passed to the runtime right before the instruction:
+     * the address of the callee of an indirect call, the length of a memcpy, memmove or memset whose length is not a constant, and the divisor of an
+     * integer division or remainder whose divisor is not a constant, sign extended for the signed ones. The runtime keeps the ValueProfileSlots most
+     * frequent values of the site with their counts, and counts the other values together. Vector and wider than 64 bit divisions are not profiled.
+     */
+    void instrumentValues(Function &F, FunctionInfo &info) {
+
+      vector<pair<Instruction*, Value*>> sites;
+      for(auto *BB: info.blocks) {
+        map<string, int> numSites;
+        for(auto &I: *BB) {
+          int kind = -1;
+          string name;
+          Value *value = NULL;
+          CallSite CS(&I);
+          if(MemIntrinsic *mem = dyn_cast<MemIntrinsic>(&I)) {
+            if(!isa<Constant>(mem->getLength())) {
+              kind = LengthSite;
+              name = string(isa<MemSetInst>(mem) ? "memset" : isa<MemMoveInst>(mem) ? "memmove" : "memcpy") + " length";
+              value = mem->getLength();
+            }
+          } else if(CS && !CS.isInlineAsm() && !isa<Function>(CS.getCalledValue()->stripPointerCasts())) {
+            kind = CalleeSite;
+            name = "indirect call";
+            value = CS.getCalledValue();
+          } else if(I.getOpcode() == Instruction::UDiv || I.getOpcode() == Instruction::SDiv || I.getOpcode() == Instruction::URem ||
+                    I.getOpcode() == Instruction::SRem) {
+            Value *divisor = I.getOperand(1);
+            if(!isa<Constant>(divisor) && divisor->getType()->isIntegerTy() && divisor->getType()->getIntegerBitWidth() <= 64) {
+              kind = DivisorSite;
+              name = string(I.getOpcodeName()) + " divisor";
+              value = divisor;
+            }
+          }
+          if(kind < 0)
+            continue;
+          // Several sites of a kind in a block are numbered in the order of the block.
+          int number = ++numSites[name];
+          name += " in " + BB->getName().str() + (number > 1 ? " #" + to_string(number) : "");
+          info.valueSites.push_back(ValueSite());
+          info.valueSites.back().kind = kind;
+          info.valueSites.back().name = name;
+          sites.push_back(make_pair(&I, value));
+        }
+      }
+      if(sites.empty())
+        return;
+
+      Module &M = *F.getParent();
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      ArrayType *valuesType = ArrayType::get(int64Ty, sites.size() * ValueProfileSlots);
+      info.siteValues = new GlobalVariable(M, valuesType, false, GlobalValue::InternalLinkage, 0, "siteValues_" + info.name);
+      info.siteValues->setInitializer(ConstantAggregateZero::get(valuesType));
+      ArrayType *countsType = ArrayType::get(int64Ty, sites.size() * (ValueProfileSlots + 1));
+      info.siteCounts = new GlobalVariable(M, countsType, false, GlobalValue::InternalLinkage, 0, "siteCounts_" + info.name);
+      info.siteCounts->setInitializer(ConstantAggregateZero::get(countsType));
+
+      // The tables are not sharded, so unless the counters are plain the runtime updates them with atomic operations.
+      std::vector<Type*> arg_types;
+      arg_types.push_back(PointerType::getUnqual(int64Ty));
+      arg_types.push_back(PointerType::getUnqual(int64Ty));
+      arg_types.push_back(int32Ty);
+      arg_types.push_back(int64Ty);
+      Function *profileValue = getLibFunction(M, CounterUpdateMode == PlainCounters ? "__cs201_profile_value" : "__cs201_profile_value_atomic",
+                                              Type::getVoidTy(*Context), arg_types);
+      for(unsigned i = 0; i < sites.size(); ++i) {
+        IRBuilder<> builder(sites[i].first);
+        Value *value = sites[i].second;
+        if(value->getType()->isPointerTy())
+          value = builder.CreatePtrToInt(value, int64Ty);
+        else if(sites[i].first->getOpcode() == Instruction::SDiv || sites[i].first->getOpcode() == Instruction::SRem)
+          value = builder.CreateSExtOrTrunc(value, int64Ty);
+        else
+          value = builder.CreateZExtOrTrunc(value, int64Ty);
+        Value *values = builder.CreateConstGEP2_32(info.siteValues, 0, i * ValueProfileSlots);
+        Value *counts = builder.CreateConstGEP2_32(info.siteCounts, 0, i * (ValueProfileSlots + 1));
+        builder.CreateCall4(profileValue, values, counts, ConstantInt::get(int32Ty, ValueProfileSlots), value);
+      }
+    }
+
+    /*
+     * The following method inserts the calling context profiling of a function. The entry block asks the runtime for the block counters of the calling
+     * context of the function, which the runtime makes the current context, and every return restores the previous context. Every call site tells the
+     * runtime which call it makes, so that the callee can find its context among the children of the current one.
+     *   previousContext; counters = __cs201_cct_enter(&contextFunction, CallingContextDepth, &previousContext);
+     *   counters[v]++ in every block v
+     *   __cs201_cct_call(&callSite) before every call, __cs201_cct_exit(previousContext) before every return
+     * A function left by an exception or a longjmp does not restore the previous context.
+     */
+    void instrumentContexts(Function &F, FunctionInfo &info) {
+
+      Module &M = *F.getParent();
+      Type *int8PtrTy = Type::getInt8PtrTy(*Context);
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Type *int8PtrPtrTy = PointerType::getUnqual(int8PtrTy);
+      Constant *zero = Constant::getNullValue(int32Ty);
+      vector<Constant*> indices;
       indices.push_back(zero);
-      Constant *var_ref = ConstantExpr::getGetElementPtr(PrintfFormatStr, indices);
+      indices.push_back(zero);
+
+      vector<Constant*> fields;
+      fields.push_back(ConstantExpr::getPointerCast(createPrivateString(M, info.name), int8PtrTy));
+      fields.push_back(ConstantInt::get(int32Ty, info.blocks.size()));
+      fields.push_back(ConstantExpr::getGetElementPtr(getBlockNames(M, info), indices));
+      Constant *contextFunction = ConstantStruct::getAnon(*Context, fields);
+      GlobalVariable *contextFunctionVar = new GlobalVariable(M, contextFunction->getType(), true, GlobalValue::PrivateLinkage, contextFunction,
+                                                              "__cs201_context_" + info.name);
+
+      std::vector<Type*> enter_arg_types;
+      enter_arg_types.push_back(int8PtrTy);
+      enter_arg_types.push_back(int32Ty);
+      enter_arg_types.push_back(int8PtrPtrTy);
+      Function *enterFunc = getLibFunction(M, "__cs201_cct_enter", PointerType::getUnqual(Type::getInt64Ty(*Context)), enter_arg_types);
+      std::vector<Type*> pointer_arg_types;
+      pointer_arg_types.push_back(int8PtrTy);
+      Function *exitFunc = getLibFunction(M, "__cs201_cct_exit", Type::getVoidTy(*Context), pointer_arg_types);
+      Function *callFunc = getLibFunction(M, "__cs201_cct_call", Type::getVoidTy(*Context), pointer_arg_types);
+
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      AllocaInst *previousContext = entryBuilder.CreateAlloca(int8PtrTy, 0, "previousContext");
+      Value *counters = entryBuilder.CreateCall3(enterFunc, ConstantExpr::getPointerCast(contextFunctionVar, int8PtrTy),
+                                                 ConstantInt::get(int32Ty, max(1U, (unsigned) CallingContextDepth)), previousContext);
+      for(unsigned v = 0; v < info.blocks.size(); ++v) {
+        IRBuilder<> builder(info.blocks[v]->getFirstInsertionPt());
+        if(v == 0)
+          builder.SetInsertPoint(entryBuilder.GetInsertBlock(), entryBuilder.GetInsertPoint());
+        emitIncrement(builder, builder.CreateConstGEP1_32(counters, v), CounterUpdateMode != PlainCounters);
+      }
+
+      for(auto &site: info.callSites) {
+        vector<Constant*> siteFields;
+        siteFields.push_back(ConstantExpr::getPointerCast(createPrivateString(M, info.name), int8PtrTy));
+        siteFields.push_back(ConstantExpr::getPointerCast(createPrivateString(M, info.blocks[site.block]->getName()), int8PtrTy));
+        Constant *callSite = ConstantStruct::getAnon(*Context, siteFields);
+        GlobalVariable *callSiteVar = new GlobalVariable(M, callSite->getType(), true, GlobalValue::PrivateLinkage, callSite, "__cs201_call_site");
+        IRBuilder<> builder(site.call);
+        builder.CreateCall(callFunc, ConstantExpr::getPointerCast(callSiteVar, int8PtrTy));
+      }
+
+      for(auto &BB: F) {
+        TerminatorInst *TI = BB.getTerminator();
+        if(isa<ReturnInst>(TI) || isa<ResumeInst>(TI)) {
+          IRBuilder<> builder(TI);
+          builder.CreateCall(exitFunc, builder.CreateLoad(previousContext));
+        }
+      }
+    }
+
+    /*
+     * The following method times the function and its loops with the cycle counter (see __cs201_time_enter). The function is entered at the start of
+     * its entry block and left before every return and resume. A loop is entered on the edges into its header from outside the loop and left on its
+     * exit edges, the returns inside it leaving it along with the function. The depth of a region in the timing stack of the thread is passed back
+     * to the runtime when the region is left, so that the regions left by an exception or a longjmp are closed along with the region around them.
+     *   depth = __cs201_time_enter(&timeCounters[0], 1) ... __cs201_time_exit(depth)
+     *   loopDepth = __cs201_time_enter(&timeCounters[2 * (l + 1)], 0) on the entry edges ... __cs201_time_exit(loopDepth) on the exit edges
+     * The loops of sampled functions and the loops with an entry or exit edge which cannot be instrumented are not timed.
+     */
+    void instrumentTiming(Function &F, FunctionInfo &info) {
+
+      Module &M = *F.getParent();
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      ArrayType *timeType = ArrayType::get(int64Ty, 2 * (info.loops.size() + 1));
+      info.timeCounters = new GlobalVariable(M, timeType, false, GlobalValue::InternalLinkage, 0, "timeCounters_" + info.name);
+      info.timeCounters->setInitializer(ConstantAggregateZero::get(timeType));
+
+      std::vector<Type*> enter_arg_types;
+      enter_arg_types.push_back(PointerType::getUnqual(int64Ty));
+      enter_arg_types.push_back(int32Ty);
+      Function *enterFunc = getLibFunction(M, "__cs201_time_enter", int32Ty, enter_arg_types);
+      std::vector<Type*> exit_arg_types;
+      exit_arg_types.push_back(int32Ty);
+      Function *exitFunc = getLibFunction(M, "__cs201_time_exit", Type::getVoidTy(*Context), exit_arg_types);
+
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      Value *depth = entryBuilder.CreateCall2(enterFunc, entryBuilder.CreateConstGEP2_32(info.timeCounters, 0, 0), ConstantInt::get(int32Ty, 1));
+      vector<Instruction*> exits;
+      for(auto &BB: F) {
+        TerminatorInst *TI = BB.getTerminator();
+        if(isa<ReturnInst>(TI) || isa<ResumeInst>(TI))
+          exits.push_back(TI);
+      }
+      for(auto *TI: exits) {
+        IRBuilder<> builder(TI);
+        builder.CreateCall(exitFunc, depth);
+      }
+
+      for(unsigned l = 0; l < info.loops.size() && !info.sampled; ++l) {
+        vector<pair<int, int>> entryEdges, exitEdges;
+        if(!getLoopEdges(info, l, entryEdges, exitEdges)) {
+          errs() << "Warning: cannot time the loop at " << info.blocks[info.loops[l].header]->getName() << "\n";
+          continue;
+        }
+
+        AllocaInst *loopDepth = entryBuilder.CreateAlloca(int32Ty, 0, "loopDepth");
+        for(auto &edge: entryEdges) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          Value *counters = builder.CreateConstGEP2_32(info.timeCounters, 0, 2 * (l + 1));
+          builder.CreateStore(builder.CreateCall2(enterFunc, counters, ConstantInt::get(int32Ty, 0)), loopDepth);
+        }
+        for(auto &edge: exitEdges) {
+          IRBuilder<> builder(getEdgeInsertionPoint(info.blocks[edge.first], info.blocks[edge.second]));
+          builder.CreateCall(exitFunc, builder.CreateLoad(loopDepth));
+        }
+      }
+    }
+
+    /*
+     * The following method moves the counter increments of the loops which call no function into local variables, so that the loop body does not
+     * load and store the counters in memory. An increment at a constant index in a block of such a loop, or in a block which splits one of its
+     * edges, is replaced by an increment of a local variable of the outermost such loop containing it, and the local variable is added to the counter
+     * and cleared again on every exit edge of the loop and before the returns inside it:
+     *   local = 0 at the function entry; local++ in the loop; counter += local; local = 0 when the loop is left
+     * The local variables are then promoted to registers. Calls of the profiling runtime and of the functions created by the pass do not count as
+     * calls, as they neither exit nor read the counters. A loop with an exit edge which cannot be instrumented keeps its counters in memory.
+     */
+    void promoteLoopCounters(Function &F, FunctionInfo &info) {
+
+      if(info.loops.empty() || info.sampled || counterUpdates.empty())
+        return;
+
+      int numLoops = info.loops.size();
+      vector<set<BasicBlock*>> loopBlocks(numLoops);
+      vector<vector<pair<BasicBlock*, BasicBlock*>>> exitEdges(numLoops);
+      vector<vector<BasicBlock*>> exitBlocks(numLoops);
+      vector<bool> promoted(numLoops, true);
+      for(int l = 0; l < numLoops; ++l) {
+        set<BasicBlock*> &blocks = loopBlocks[l];
+        for(auto b: info.loops[l].blocks)
+          blocks.insert(info.blocks[b]);
+        for(auto &edgeBlock: edgeBlocks) {
+          if(blocks.count(edgeBlock.first.first) && blocks.count(edgeBlock.first.second))
+            blocks.insert(edgeBlock.second);
+        }
+        for(auto *BB: blocks) {
+          for(auto &I: *BB) {
+            CallSite CS(&I);
+            if(!CS || isa<IntrinsicInst>(&I))
+              continue;
+            Function *callee = dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts());
+            if(!callee || !callee->getName().startswith("__cs201_"))
+              promoted[l] = false;
+          }
+          TerminatorInst *TI = BB->getTerminator();
+          if(TI->getNumSuccessors() == 0)
+            exitBlocks[l].push_back(BB);
+          for(unsigned s = 0, e = TI->getNumSuccessors(); s != e; ++s) {
+            BasicBlock *succ = TI->getSuccessor(s);
+            if(blocks.count(succ) || find(exitEdges[l].begin(), exitEdges[l].end(), make_pair(BB, succ)) != exitEdges[l].end())
+              continue;
+            exitEdges[l].push_back(make_pair(BB, succ));
+            if(!canInstrumentEdge(BB, succ))
+              promoted[l] = false;
+          }
+        }
+      }
+
+      // Here we replace the increments, every counter getting one local variable per loop.
+      IRBuilder<> entryBuilder(F.getEntryBlock().getFirstInsertionPt());
+      vector<map<Value*, AllocaInst*>> locals(numLoops);
+      vector<AllocaInst*> allocas;
+      for(auto &counterUpdate: counterUpdates) {
+        Instruction *update = counterUpdate.second;
+        int loop = -1;
+        for(int l = 0; l < numLoops; ++l) {
+          if(promoted[l] && loopBlocks[l].count(update->getParent()) && (loop < 0 || loopBlocks[l].size() > loopBlocks[loop].size()))
+            loop = l;
+        }
+        if(loop < 0)
+          continue;
+
+        AllocaInst *&local = locals[loop][counterUpdate.first];
+        if(!local) {
+          local = entryBuilder.CreateAlloca(counterUpdate.first->getType()->getPointerElementType(), 0, "localCounter");
+          entryBuilder.CreateStore(Constant::getNullValue(local->getAllocatedType()), local);
+          allocas.push_back(local);
+        }
+        IRBuilder<> builder(update);
+        emitIncrement(builder, local, false);
+        if(StoreInst *store = dyn_cast<StoreInst>(update)) {
+          Value *sum = store->getValueOperand();
+          store->eraseFromParent();
+          RecursivelyDeleteTriviallyDeadInstructions(sum);
+        } else {
+          update->eraseFromParent();
+        }
+      }
+
+      // Here we add the local variables to the counters when the loops are left.
+      for(int l = 0; l < numLoops; ++l) {
+        if(locals[l].empty())
+          continue;
+        vector<Instruction*> flushPoints;
+        for(auto &edge: exitEdges[l])
+          flushPoints.push_back(getEdgeInsertionPoint(edge.first, edge.second));
+        for(auto *BB: exitBlocks[l])
+          flushPoints.push_back(BB->getTerminator());
+        for(auto *flushPoint: flushPoints) {
+          IRBuilder<> builder(flushPoint);
+          for(auto &local: locals[l]) {
+            emitAdd(builder, local.first, builder.CreateLoad(local.second), CounterUpdateMode == AtomicCounters);
+            builder.CreateStore(Constant::getNullValue(local.second->getAllocatedType()), local.second);
+          }
+        }
+      }
+
+      DominatorTree DT;
+      DT.recalculate(F);
+      PromoteMemToReg(allocas, DT);
+    }
 
-      Value *bbc = ConstantInt::get(*Context, APInt(32, StringRef("0"), 10));
-      CallInst *call = builder.CreateCall2(printf_func, var_ref, bbc);
-      call->setTailCall(false);
+    /*
+     * The following method inserts the instructions which count the path whose number is the value of the path register plus the given increment.
+     */
+    void emitPathCountIncrement(IRBuilder<> &builder, PathProfileInfo &info, Value *pathRegister, int64_t inc) {
+
+      Value *path = builder.CreateLoad(pathRegister);
+      if(inc != 0)
+        path = builder.CreateAdd(path, ConstantInt::get(Type::getInt64Ty(*Context), inc));
+
+      if(info.dense) {
+        emitCounterIncrement(builder, info.counters, path);
+        return;
+      }
+
+      Module &M = *builder.GetInsertBlock()->getParent()->getParent();
+      Value *keys = builder.CreateConstGEP2_32(info.keys, 0, 0);
+      Value *counters = builder.CreateConstGEP2_32(info.counters, 0, 0);
+      Value *mask = ConstantInt::get(Type::getInt64Ty(*Context), info.tableSize - 1);
+      std::vector<Value*> args;
+      args.push_back(keys);
+      args.push_back(counters);
+      args.push_back(mask);
+      args.push_back(path);
+      args.push_back(info.overflow);
+      builder.CreateCall(getPathTableIncrementFunction(M), args);
+    }
+
+    /*
+     * The following method returns the function which counts a path in the hash table of a function, creating it the first time. The table uses open
+     * addressing with linear probing, and stores the path number + 1 in the key of every used slot. A path which does not find a free slot within a few
+     * probes is counted in the overflow counter instead. Unless the counters are plain, the table is shared by all the threads (it is not sharded) and a
+     * slot is claimed with a compare and exchange of its key followed by an atomic increment of its counter.
+     *   key = path + 1; slot = hash(key) & mask;
+     *   for(probe = 0; probe < 16; probe++, slot = (slot + 1) & mask) {
+     *     if(keys[slot] == key) { counters[slot]++; return; }
+     *     if(keys[slot] == 0) { keys[slot] = key; counters[slot] = 1; return; }
+     *   }
+     *   (*overflow)++;
+     */
+    Function* getPathTableIncrementFunction(Module &M) {
+
+      Function *func = M.getFunction("__cs201_path_table_increment");
+      if(func)
+        return func;
+
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      std::vector<Type*> arg_types;
+      arg_types.push_back(PointerType::getUnqual(int64Ty));
+      arg_types.push_back(PointerType::getUnqual(getCounterType()));
+      arg_types.push_back(int64Ty);
+      arg_types.push_back(int64Ty);
+      arg_types.push_back(PointerType::getUnqual(getCounterType()));
+      FunctionType *func_type = FunctionType::get(Type::getVoidTy(*Context), arg_types, false);
+      func = Function::Create(func_type, GlobalValue::InternalLinkage, "__cs201_path_table_increment", &M);
+      Function::arg_iterator args = func->arg_begin();
+      Value *keys = &*args++;
+      Value *counters = &*args++;
+      Value *mask = &*args++;
+      Value *path = &*args++;
+      Value *overflow = &*args++;
+
+      BasicBlock *entry = BasicBlock::Create(*Context, "entry", func);
+      BasicBlock *probe = BasicBlock::Create(*Context, "probe", func);
+      BasicBlock *hit = BasicBlock::Create(*Context, "hit", func);
+      BasicBlock *checkEmpty = BasicBlock::Create(*Context, "check.empty", func);
+      BasicBlock *next = BasicBlock::Create(*Context, "next", func);
+      BasicBlock *full = BasicBlock::Create(*Context, "full", func);
+
+      IRBuilder<> builder(entry);
+      Value *key = builder.CreateAdd(path, ConstantInt::get(int64Ty, 1));
+      Value *hash = builder.CreateMul(key, ConstantInt::get(int64Ty, 0x9E3779B97F4A7C15ULL));
+      hash = builder.CreateXor(hash, builder.CreateLShr(hash, 32));
+      Value *firstSlot = builder.CreateAnd(hash, mask);
+      builder.CreateBr(probe);
+
+      builder.SetInsertPoint(probe);
+      PHINode *slot = builder.CreatePHI(int64Ty, 2, "slot");
+      PHINode *probes = builder.CreatePHI(int32Ty, 2, "probes");
+      Value *keyVal = builder.CreateGEP(keys, slot);
+      Value *counterVal = builder.CreateGEP(counters, slot);
+      if(CounterUpdateMode == PlainCounters) {
+        Value *oldKey = builder.CreateLoad(keyVal);
+        builder.CreateCondBr(builder.CreateICmpEQ(oldKey, key), hit, checkEmpty);
+
+        builder.SetInsertPoint(checkEmpty);
+        BasicBlock *claim = BasicBlock::Create(*Context, "claim", func, next);
+        builder.CreateCondBr(builder.CreateICmpEQ(oldKey, ConstantInt::get(int64Ty, 0)), claim, next);
+
+        builder.SetInsertPoint(claim);
+        builder.CreateStore(key, keyVal);
+        builder.CreateStore(ConstantInt::get(getCounterType(), 1), counterVal);
+        builder.CreateRetVoid();
+      } else {
+        Value *oldKey = builder.CreateExtractValue(builder.CreateAtomicCmpXchg(keyVal, ConstantInt::get(int64Ty, 0), key, Monotonic, Monotonic), 0);
+        builder.CreateCondBr(builder.CreateICmpEQ(oldKey, key), hit, checkEmpty);
+
+        builder.SetInsertPoint(checkEmpty);
+        builder.CreateCondBr(builder.CreateICmpEQ(oldKey, ConstantInt::get(int64Ty, 0)), hit, next);
+      }
+
+      builder.SetInsertPoint(hit);
+      emitIncrement(builder, counterVal, CounterUpdateMode != PlainCounters);
+      builder.CreateRetVoid();
+
+      builder.SetInsertPoint(next);
+      Value *nextSlot = builder.CreateAnd(builder.CreateAdd(slot, ConstantInt::get(int64Ty, 1)), mask);
+      Value *nextProbes = builder.CreateAdd(probes, ConstantInt::get(int32Ty, 1));
+      builder.CreateCondBr(builder.CreateICmpULT(nextProbes, ConstantInt::get(int32Ty, 16)), probe, full);
+      slot->addIncoming(firstSlot, entry);
+      slot->addIncoming(nextSlot, next);
+      probes->addIncoming(ConstantInt::get(int32Ty, 0), entry);
+      probes->addIncoming(nextProbes, next);
+
+      builder.SetInsertPoint(full);
+      emitIncrement(builder, overflow, CounterUpdateMode != PlainCounters);
+      builder.CreateRetVoid();
+
+      return func;
+    }
+
+    /*
+     * The following method computes the identities of the blocks of a function and its structural hash, which are stored in the binary profile
+     * (see computeCS201BlockHashes).
+     */
+    void computeBlockHashes(FunctionInfo &info) {
+
+      vector<CS201BlockRecord> records;
+      info.structuralHash = computeCS201BlockHashes(info.blocks, info.edges, records);
+      info.blockHashes.clear();
+      info.blockLines.clear();
+      for(auto &record: records) {
+        info.blockHashes.push_back(record.hash);
+        info.blockLines.push_back(record.line);
+      }
+    }
+
+    /*
+     * The following method returns the size of the counter arrays of the module, the thread local shards of sharded counters and the calling
+     * context tree allocated at run time excepted.
+     */
+    uint64_t countCounterBytes(Module &M) {
+
+      DataLayout layout(&M);
+      uint64_t size = 0;
+      for(auto &info: functions) {
+        GlobalVariable *arrays[] = { info.counters, info.paths.counters, info.paths.keys, info.paths.overflow, info.loopHistogram,
+                                     info.siteValues, info.siteCounts, info.timeCounters, info.strideCounters, info.strides, info.coverage };
+        for(auto counter: arrays) {
+          if(counter)
+            size += layout.getTypeAllocSize(counter->getType()->getPointerElementType());
+        }
+      }
+      return size;
+    }
+
+    /*
+     * The following method moves all the counter arrays of the module into the fields of one global variable which starts and ends on a page
+     * boundary, so that the runtime can map it from the live counters file. Every use of a counter array is replaced by the address of its field.
+     * The shards of sharded counters stay thread local, and are merged into the mapped counters.
+     */
+    void mergeCounters(Module &M) {
+
+      vector<GlobalVariable*> counters;
+      for(auto &info: functions) {
+        GlobalVariable *arrays[] = { info.counters, info.paths.counters, info.paths.keys, info.paths.overflow, info.loopHistogram,
+                                     info.siteValues, info.siteCounts, info.timeCounters, info.strideCounters, info.strides };
+        for(auto counter: arrays) {
+          if(counter)
+            counters.push_back(counter);
+        }
+      }
+
+      // The fields are packed, so every array is preceded by padding up to its alignment, the cache line of the arrays of createCounterArray
+      // and the size of its counters for the others. The arrays go by decreasing alignment and counter size to keep the padding small. The
+      // padding at the end makes the size a multiple of the page size.
+      auto elementSize = [](GlobalVariable *counter) -> uint64_t {
+        Type *type = counter->getType()->getPointerElementType();
+        return (type->isArrayTy() ? type->getArrayElementType() : type)->getPrimitiveSizeInBits() / 8;
+      };
+      auto alignment = [&](GlobalVariable *counter) { return max<uint64_t>(counter->getAlignment(), elementSize(counter)); };
+      stable_sort(counters.begin(), counters.end(), [&](GlobalVariable *a, GlobalVariable *b) {
+        return make_pair(alignment(a), elementSize(a)) > make_pair(alignment(b), elementSize(b));
+      });
+      vector<Type*> fieldTypes;
+      vector<unsigned> fields;
+      uint64_t size = 0;
+      for(auto counter: counters) {
+        Type *type = counter->getType()->getPointerElementType();
+        uint64_t padding = (alignment(counter) - size % alignment(counter)) % alignment(counter);
+        if(padding > 0)
+          fieldTypes.push_back(ArrayType::get(Type::getInt8Ty(*Context), padding));
+        fields.push_back(fieldTypes.size());
+        fieldTypes.push_back(type);
+        size += padding + elementSize(counter) * (type->isArrayTy() ? type->getArrayNumElements() : 1);
+      }
+      fieldTypes.push_back(ArrayType::get(Type::getInt8Ty(*Context), (CS201_COUNTERS_PAGE_SIZE - size % CS201_COUNTERS_PAGE_SIZE) % CS201_COUNTERS_PAGE_SIZE));
+      StructType *mergedType = StructType::get(*Context, fieldTypes, true);
+      mergedCounters = new GlobalVariable(M, mergedType, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(mergedType), "__cs201_counters");
+      mergedCounters->setAlignment(CS201_COUNTERS_PAGE_SIZE);
+
+      for(unsigned i = 0; i < counters.size(); ++i) {
+        vector<Constant*> indices;
+        indices.push_back(ConstantInt::get(Type::getInt32Ty(*Context), 0));
+        indices.push_back(ConstantInt::get(Type::getInt32Ty(*Context), fields[i]));
+        Constant *address = ConstantExpr::getGetElementPtr(mergedCounters, indices);
+        counters[i]->replaceAllUsesWith(address);
+        mergedCounterAddresses[counters[i]] = address;
+      }
+    }
+
+    /*
+     * The following method creates the descriptor of the module which is registered with the profiling runtime (see CS201ProfilingRuntime.h).
+     * For every function it holds the edges, the counter arrays and the counter expressions of the blocks, edges and loop entries as a list of terms,
+     * so that the runtime can compute the counts written to the binary profile, along with the names of the blocks, the loops, the call sites, the
+     * paths and the value profiling sites, from which the runtime prints the profiling data. The size of the code of the module thus does not grow
+     * with the number of blocks and edges. It also lists all the counter storage of the module, which the runtime clears on a reset. The counts of
+     * the path hash tables are not part of the binary profile.
+     */
+    GlobalVariable* createModuleDescriptor(Module &M) {
+
+      Type *int8PtrTy = Type::getInt8PtrTy(*Context);
+      Type *int32Ty = Type::getInt32Ty(*Context);
+      Type *int64Ty = Type::getInt64Ty(*Context);
+      Type *int32PtrTy = PointerType::getUnqual(int32Ty);
+      Type *voidFuncPtrTy = PointerType::getUnqual(FunctionType::get(Type::getVoidTy(*Context), false));
+      Constant *zero = Constant::getNullValue(int32Ty);
+      vector<Constant*> indices;
+      indices.push_back(zero);
+      indices.push_back(zero);
+
+      // Returns a pointer to the first element of a new constant array, or a null pointer if the array is empty.
+      auto createArray = [&](const vector<uint32_t> &values, Twine name) -> Constant* {
+        if(values.empty())
+          return Constant::getNullValue(int32PtrTy);
+        Constant *array = ConstantDataArray::get(*Context, values);
+        GlobalVariable *var = new GlobalVariable(M, array->getType(), true, GlobalValue::PrivateLinkage, array, name);
+        return ConstantExpr::getGetElementPtr(var, indices);
+      };
+      auto counterPointer = [&](GlobalVariable *counter) -> Constant* {
+        if(!counter)
+          return Constant::getNullValue(int32PtrTy);
+        if(mergedCounters)
+          return ConstantExpr::getPointerCast(mergedCounterAddresses[counter], int32PtrTy);
+        return ConstantExpr::getPointerCast(counter, int32PtrTy);
+      };
+      // Returns a pointer to an element of a counter array, or a null pointer if there is no array.
+      auto counterElement = [&](GlobalVariable *counter, uint64_t index) -> Constant* {
+        if(!counter)
+          return Constant::getNullValue(int32PtrTy);
+        vector<Constant*> element;
+        element.push_back(zero);
+        element.push_back(ConstantInt::get(int64Ty, index));
+        return ConstantExpr::getPointerCast(ConstantExpr::getGetElementPtr(mergedCounters ? mergedCounterAddresses[counter] : counter, element), int32PtrTy);
+      };
+      // Returns a pointer to the first element of a new constant array of (name, number) or (pointer, name) records, or a null pointer if there
+      // are no records.
+      auto createRecords = [&](const vector<Constant*> &records, Twine name) -> Constant* {
+        if(records.empty())
+          return Constant::getNullValue(int8PtrTy);
+        ArrayType *arrayType = ArrayType::get(records[0]->getType(), records.size());
+        GlobalVariable *var = new GlobalVariable(M, arrayType, true, GlobalValue::PrivateLinkage, ConstantArray::get(arrayType, records), name);
+        return ConstantExpr::getPointerCast(var, int8PtrTy);
+      };
+      auto createRecord = [&](Constant *first, Constant *second) -> Constant* {
+        vector<Constant*> fields;
+        fields.push_back(first);
+        fields.push_back(second);
+        return ConstantStruct::getAnon(*Context, fields);
+      };
+      auto stringPointer = [&](string str) -> Constant* {
+        return ConstantExpr::getPointerCast(createPrivateString(M, str), int8PtrTy);
+      };
+
+      vector<Type*> functionFields;
+      functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int64Ty);
+      functionFields.push_back(int32Ty);
+      functionFields.push_back(int32Ty);
+      functionFields.push_back(int32Ty);
+      for(int i = 0; i < 7; ++i)
+        functionFields.push_back(int32PtrTy);
+      functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int32Ty);
+      functionFields.push_back(int32Ty);
+      for(int i = 0; i < 7; ++i)
+        functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int32Ty);
+      functionFields.push_back(int32Ty);
+      for(int i = 0; i < 4; ++i)
+        functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int32PtrTy);
+      functionFields.push_back(int32Ty);
+      for(int i = 0; i < 4; ++i)
+        functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int64Ty);
+      functionFields.push_back(int8PtrTy);
+      functionFields.push_back(int32PtrTy);
+      functionFields.push_back(int32Ty);
+      StructType *functionType = StructType::get(*Context, functionFields);
+
+      vector<Constant*> functionDescriptors;
+      vector<Constant*> regions;
+      vector<Type*> regionFields;
+      regionFields.push_back(int8PtrTy);
+      regionFields.push_back(int64Ty);
+      StructType *regionType = StructType::get(*Context, regionFields);
+      // With merged counters the only region is the block holding all of them.
+      auto addRegion = [&](GlobalVariable *counter) {
+        if(!counter || (mergedCounters && counter != mergedCounters))
+          return;
+        vector<Constant*> region;
+        region.push_back(ConstantExpr::getPointerCast(counter, int8PtrTy));
+        region.push_back(ConstantExpr::getSizeOf(counter->getType()->getPointerElementType()));
+        regions.push_back(ConstantStruct::get(regionType, region));
+      };
+      for(auto &info: functions) {
+        vector<uint32_t> edgeRecords;
+        for(auto &edge: info.edges) {
+          edgeRecords.push_back(edge.first);
+          edgeRecords.push_back(edge.second);
+        }
+        // The terms are stored as (array, index, coefficient) triples.
+        vector<uint32_t> termStart, terms;
+        // The entries of a loop are the edges into its header from outside the loop.
+        vector<CounterExpr> loopEntries(info.loops.size());
+        for(unsigned l = 0; l < info.loops.size(); ++l) {
+          NaturalLoop &loop = info.loops[l];
+          for(unsigned e = 0; e < info.edges.size(); ++e) {
+            if(info.edges[e].second != loop.header || find(loop.backEdges.begin(), loop.backEdges.end(), (int) e) != loop.backEdges.end())
+              continue;
+            for(auto &term: info.edgeCounts[e])
+              loopEntries[l][term.first] += term.second;
+          }
+        }
+        vector<CounterExpr*> counts;
+        for(auto &count: info.blockCounts)
+          counts.push_back(&count);
+        for(auto &count: info.edgeCounts)
+          counts.push_back(&count);
+        for(auto &count: loopEntries)
+          counts.push_back(&count);
+        for(auto count: counts) {
+          termStart.push_back(terms.size() / 3);
+          for(auto &term: *count) {
+            if(term.second == 0)
+              continue;
+            terms.push_back(term.first.first);
+            terms.push_back(term.first.second);
+            terms.push_back((uint32_t) term.second);
+          }
+        }
+        termStart.push_back(terms.size() / 3);
+
+        vector<Constant*> loops, callEdges, valueSites, memorySites;
+        for(auto &loop: info.loops) {
+          string blocks;
+          for(auto b: loop.blocks)
+            blocks += info.blocks[b]->getName().str() + " ";
+          loops.push_back(createRecord(stringPointer(blocks), ConstantInt::get(int32Ty, loop.header)));
+        }
+        for(auto &site: info.callSites) {
+          Constant *callee = site.callee.empty() ? Constant::getNullValue(int8PtrTy) : stringPointer(site.callee);
+          callEdges.push_back(createRecord(callee, ConstantInt::get(int32Ty, site.block)));
+        }
+        for(auto &site: info.valueSites)
+          valueSites.push_back(createRecord(stringPointer(site.name), ConstantInt::get(int32Ty, site.kind)));
+        for(auto &site: info.memorySites)
+          memorySites.push_back(createRecord(stringPointer(site.name), ConstantInt::get(int32Ty, site.block)));
+
+        GlobalVariable *pathCounters = info.paths.dense ? info.paths.counters : NULL;
+        GlobalVariable *pathTable = info.paths.dense ? NULL : info.paths.counters;
+        vector<Constant*> fields;
+        fields.push_back(ConstantExpr::getPointerCast(createPrivateString(M, info.name), int8PtrTy));
+        fields.push_back(ConstantInt::get(int64Ty, computeCS201CFGChecksum(info.blocks.size(), info.edges)));
+        fields.push_back(ConstantInt::get(int32Ty, info.blocks.size()));
+        fields.push_back(ConstantInt::get(int32Ty, info.edges.size()));
+        fields.push_back(ConstantInt::get(int32Ty, pathCounters ? info.paths.numPaths : 0));
+        fields.push_back(createArray(edgeRecords, "__cs201_edges_" + info.name));
+        fields.push_back(counterPointer(info.numBlockCounters > 0 ? info.counters : NULL));
+        fields.push_back(counterElement(info.counters, info.numBlockCounters));
+        fields.push_back(counterPointer(pathCounters));
+        fields.push_back(createArray(termStart, "__cs201_term_start_" + info.name));
+        fields.push_back(createArray(terms, "__cs201_terms_" + info.name));
+        fields.push_back(info.sampled ? (Constant*) sampleInterval : Constant::getNullValue(int32PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(getBlockNames(M, info), int8PtrTy));
+        fields.push_back(ConstantInt::get(int32Ty, loops.size()));
+        fields.push_back(ConstantInt::get(int32Ty, callEdges.size()));
+        fields.push_back(createRecords(loops, "__cs201_loops_" + info.name));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.loopHistogram), int8PtrTy));
+        fields.push_back(createRecords(callEdges, "__cs201_call_edges_" + info.name));
+        fields.push_back(info.paths.names ? ConstantExpr::getPointerCast(info.paths.names, int8PtrTy) : Constant::getNullValue(int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.paths.keys), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(pathTable), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.paths.overflow), int8PtrTy));
+        fields.push_back(ConstantInt::get(int32Ty, pathTable ? info.paths.tableSize : 0));
+        fields.push_back(ConstantInt::get(int32Ty, valueSites.size()));
+        fields.push_back(createRecords(valueSites, "__cs201_value_sites_" + info.name));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.siteValues), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.siteCounts), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.timeCounters), int8PtrTy));
+        fields.push_back(createArray(info.blockAccesses, "__cs201_block_accesses_" + info.name));
+        fields.push_back(ConstantInt::get(int32Ty, memorySites.size()));
+        fields.push_back(createRecords(memorySites, "__cs201_memory_sites_" + info.name));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.strideCounters), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.strides), int8PtrTy));
+        fields.push_back(ConstantExpr::getPointerCast(counterPointer(info.coverage), int8PtrTy));
+        fields.push_back(ConstantInt::get(int64Ty, info.structuralHash));
+        Constant *blockHashes = ConstantDataArray::get(*Context, info.blockHashes);
+        fields.push_back(ConstantExpr::getPointerCast(new GlobalVariable(M, blockHashes->getType(), true, GlobalValue::PrivateLinkage, blockHashes,
+                                                                         "__cs201_block_hashes_" + info.name), int8PtrTy));
+        fields.push_back(createArray(info.blockLines, "__cs201_block_lines_" + info.name));
+        fields.push_back(ConstantInt::get(int32Ty, getCounterType()->getPrimitiveSizeInBits() / 8));
+        functionDescriptors.push_back(ConstantStruct::get(functionType, fields));
+
+        addRegion(info.counters);
+        addRegion(info.paths.counters);
+        addRegion(info.paths.keys);
+        addRegion(info.paths.overflow);
+        addRegion(info.loopHistogram);
+        addRegion(info.siteValues);
+        addRegion(info.siteCounts);
+        addRegion(info.timeCounters);
+        addRegion(info.strideCounters);
+        addRegion(info.strides);
+        addRegion(info.coverage);
+      }
+      addRegion(mergedCounters);
+
+      ArrayType *functionArrayType = ArrayType::get(functionType, functionDescriptors.size());
+      GlobalVariable *functionArray = new GlobalVariable(M, functionArrayType, true, GlobalValue::PrivateLinkage,
+                                                         ConstantArray::get(functionArrayType, functionDescriptors), "__cs201_functions");
+      ArrayType *regionArrayType = ArrayType::get(regionType, regions.size());
+      GlobalVariable *regionArray = new GlobalVariable(M, regionArrayType, true, GlobalValue::PrivateLinkage,
+                                                       ConstantArray::get(regionArrayType, regions), "__cs201_regions");
+
+      // The callees of the indirect calls are printed by name when they are functions of the module whose address is taken, the functions of the
+      // pass excepted.
+      vector<Constant*> callees;
+      bool hasCalleeSites = false;
+      for(auto &info: functions) {
+        for(auto &site: info.valueSites)
+          hasCalleeSites |= site.kind == CalleeSite;
+      }
+      for(auto &callee: M) {
+        if(hasCalleeSites && callee.hasAddressTaken() && !callee.getName().startswith("__cs201_"))
+          callees.push_back(createRecord(ConstantExpr::getPointerCast(&callee, int8PtrTy), stringPointer(callee.getName())));
+      }
+
+      vector<Constant*> fields;
+      fields.push_back(Constant::getNullValue(int8PtrTy));
+      fields.push_back(ConstantExpr::getPointerCast(createPrivateString(M, M.getModuleIdentifier()), int8PtrTy));
+      fields.push_back(ConstantInt::get(int32Ty, CS201_RUNTIME_VERSION));
+      fields.push_back(ConstantInt::get(int32Ty, (BinaryProfile ? CS201_MODULE_WRITE_PROFILE : 0) | (mergedCounters ? CS201_MODULE_MAPPED_COUNTERS : 0) |
+                                        (ValueProfiling ? CS201_MODULE_VALUE_PROFILING : 0) | (Timing ? CS201_MODULE_TIMING : 0) |
+                                        (MemoryProfiling ? CS201_MODULE_MEMORY_PROFILING : 0) | (Coverage ? CS201_MODULE_COVERAGE : 0)));
+      fields.push_back(ConstantInt::get(int32Ty, functionDescriptors.size()));
+      fields.push_back(ConstantInt::get(int32Ty, regions.size()));
+      fields.push_back(ConstantExpr::getGetElementPtr(functionArray, indices));
+      fields.push_back(ConstantExpr::getGetElementPtr(regionArray, indices));
+      fields.push_back(flushShardFunc ? (Constant*) flushShardFunc : Constant::getNullValue(voidFuncPtrTy));
+      fields.push_back(ConstantInt::get(int32Ty, ValueProfileSlots));
+      fields.push_back(ConstantInt::get(int32Ty, callees.size()));
+      fields.push_back(createRecords(callees, "__cs201_callees"));
+      Constant *descriptor = ConstantStruct::getAnon(*Context, fields);
+      // The runtime links the registered descriptors through their first field, so the descriptor is not constant.
+      return new GlobalVariable(M, descriptor->getType(), false, GlobalValue::InternalLinkage, descriptor, "__cs201_module");
+    }
+
+    /*
+     * The following method returns the array of the names of the blocks of a function, creating it the first time.
+     */
+    GlobalVariable* getBlockNames(Module &M, FunctionInfo &info) {
+
+      if(info.blockNames)
+        return info.blockNames;
+      Type *int8PtrTy = Type::getInt8PtrTy(*Context);
+      vector<Constant*> names;
+      for(auto *BB: info.blocks)
+        names.push_back(ConstantExpr::getPointerCast(createPrivateString(M, BB->getName()), int8PtrTy));
+      ArrayType *namesType = ArrayType::get(int8PtrTy, names.size());
+      info.blockNames = new GlobalVariable(M, namesType, true, GlobalValue::PrivateLinkage, ConstantArray::get(namesType, names),
+                                           "__cs201_block_names_" + info.name);
+      return info.blockNames;
+    }
+
+    /*
+     * The following method creates a private global variable holding a null terminated string.
+     */
+    GlobalVariable* createPrivateString(Module &M, string str) {
+
+      Constant *str_const = ConstantDataArray::getString(*Context, str);
+      return new GlobalVariable(M, str_const->getType(), true, GlobalValue::PrivateLinkage, str_const, "NameStr");
+    }
+
+    /*
+     * The following method is used to print the computed immediate dominators of a particular function.
+     * The dominator set of a block is the block itself followed by the dominator set of its immediate dominator.
+     */
+    void printDominatorSet(FunctionInfo &info) {
+
+      errs() << "\nImmediateDominators:\n";
+      for(unsigned v = 1; v < info.blocks.size(); ++v) {
+          errs() << "IDom[" << info.blocks[v]->getName() << "] => ";
+          if(info.idom[v] == -1)
+            errs() << "(unreachable)";
+          else
+            errs() << info.blocks[info.idom[v]]->getName();
+          errs() << "\n";
+      }
+    }    
+
+    /*
+     * The following method is used to print the loops inside a particular function.
+     */
+    void printLoops(FunctionInfo &info) {
+
+      if(info.loops.size() > 0) {
+        errs() << "\nLoops:\n";
+        for(auto &loop: info.loops) {
+          for(auto block: loop.blocks) {
+            errs() << info.blocks[block]->getName() << " ";
+          }
+          errs() << "(header " << info.blocks[loop.header]->getName() << ", latches";
+          for(auto latch: loop.latches) {
+            errs() << " " << info.blocks[latch]->getName();
+          }
+          errs() << ")\n";
+        }
+      }
     }
   };
 }
@@ -0,0 +1,31 @@
+# Measures the time the pass takes to instrument synthetic functions of 10^3 to 10^5 basic blocks.
+# Run it from the bench directory after building the pass (make in the parent directory).
+# Usage: ./compileTime.sh [opt options...]   e.g. ./compileTime.sh -spanning-tree-counters
+LLVM_HOME=~/Workspace
+if [ $(uname -s) == "Darwin" ]; then
+    SHARED_LIB_EXT=dylib;
+else
+    SHARED_LIB_EXT=so;
+fi
+OPT=${LLVM_HOME}/llvm/Release+Asserts/bin/opt
+PASS=../../../../Release+Asserts/lib/CS201Profiling.${SHARED_LIB_EXT}
+SIZES="1000 3000 10000 30000 100000"
+
+# Prints the wall time of a phase of the pass from the -time-passes report of a log.
+phase() {
+    sed -n "s/.* \([0-9.]*\) ( *[0-9.]*%)  $2\$/\1/p" $1
+}
+
+mkdir -p out
+printf "%-10s %-10s %-10s %-16s %s\n" "blocks" "seconds" "analysis" "instrumentation" "descriptor"
+for SIZE in ${SIZES}; do
+    python genCFG.py ${SIZE} > out/cfg${SIZE}.c && \
+        clang -emit-llvm -O0 -c out/cfg${SIZE}.c -o out/cfg${SIZE}.bc || exit 1
+    # The statistics and the phase timers of the pass are kept in the log, the number of blocks coming from the statistics.
+    START=$(date +%s.%N)
+    ${OPT} -load ${PASS} -pathProfiling -stats -time-passes "$@" out/cfg${SIZE}.bc -o out/cfg${SIZE}.prof.bc 2> out/cfg${SIZE}.log || exit 1
+    END=$(date +%s.%N)
+    BLOCKS=$(sed -n "s/^ *\([0-9]*\) cs201-profiling - Number of blocks instrumented$/\1/p" out/cfg${SIZE}.log)
+    printf "%-10s %-10s %-10s %-16s %s\n" ${BLOCKS} $(echo "${END} - ${START}" | bc) $(phase out/cfg${SIZE}.log Analysis) \
+        $(phase out/cfg${SIZE}.log Instrumentation) $(phase out/cfg${SIZE}.log "Descriptor generation")
+done
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+#
+# Generates a C program whose function "f" has roughly the requested number of basic blocks (at -O0), made of
+# if/else diamonds, switches and loops nested up to a fixed depth. It is used to measure how the compile time
+# of the pass scales with the size of a function.
+#
+# main calls f once, or the given number of times to make a long running program (see overhead.py).
+#
+# Usage: genCFG.py <number of blocks> [seed] [calls] > cfg.c
+
+import random
+import sys
+
+MAX_DEPTH = 3
+
+
+class Generator(object):
+
+    def __init__(self, blocks, seed, calls=1):
+        self.budget = blocks
+        self.calls = calls
+        self.random = random.Random(seed)
+        self.loops = 0
+        self.lines = []
+
+    def emit(self, depth, text):
+        self.lines.append("  " * (depth + 1) + text)
+
+    def statement(self, depth):
+        kind = self.random.randint(0, 9)
+        if kind < 5 or depth >= MAX_DEPTH:
+            # if (x & k) { ... } else { ... }: condition, then, else and join blocks.
+            self.budget -= 4
+            self.emit(depth, "if (x & %d) {" % (1 << self.random.randint(0, 7)))
+            self.emit(depth + 1, "x = x * 3 + %d;" % self.random.randint(1, 100))
+            self.emit(depth, "} else {")
+            self.emit(depth + 1, "x = (x >> 1) ^ %d;" % self.random.randint(1, 100))
+            self.emit(depth, "}")
+        elif kind < 7:
+            # switch with a few cases: the switch, one block per case and the join block.
+            cases = self.random.randint(2, 6)
+            self.budget -= cases + 2
+            self.emit(depth, "switch (x %% %d) {" % (cases + 1))
+            for c in range(cases):
+                self.emit(depth, "case %d:" % c)
+                self.emit(depth + 1, "x += %d;" % self.random.randint(1, 100))
+                self.emit(depth + 1, "break;")
+            self.emit(depth, "}")
+        else:
+            # for loop running a few iterations: condition, body, increment and exit blocks, plus the nested statements.
+            self.budget -= 4
+            var = "i%d" % self.loops
+            self.loops += 1
+            self.emit(depth, "for (int %s = 0; %s < 3; %s++) {" % (var, var, var))
+            for _ in range(self.random.randint(1, 3)):
+                if self.budget <= 0:
+                    break
+                self.statement(depth + 1)
+            self.emit(depth, "}")
+
+    def generate(self):
+        while self.budget > 0:
+            self.statement(0)
+        out = ["#include <stdio.h>", "", "int f(int x) {"]
+        out.extend(self.lines)
+        out.extend(["  return x;", "}", "", "int main(int argc, char **argv) {"])
+        if self.calls == 1:
+            out.append("  printf(\"%d\\n\", f(argc));")
+        else:
+            out.extend(["  int x = argc;",
+                        "  for (int c = 0; c < %d; c++)" % self.calls,
+                        "    x = f(x + c);",
+                        "  printf(\"%d\\n\", x);"])
+        out.extend(["  return 0;", "}", ""])
+        return "\n".join(out)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s <number of blocks> [seed] [calls]\n" % sys.argv[0])
+        sys.exit(1)
+    blocks = int(sys.argv[1])
+    seed = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+    calls = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+    sys.stdout.write(Generator(blocks, seed, calls).generate())
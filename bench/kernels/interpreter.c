@@ -0,0 +1,62 @@
+/*
+ * Switch heavy interpreter: a small stack machine running a bytecode program which counts the primes below a bound by trial division.
+ * Usage: interpreter [bound]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum Opcode { PUSH, LOAD, STORE, ADD, SUB, MUL, MOD, LT, JZ, JMP, INC, PRINT, HALT };
+
+struct Instruction {
+  int opcode;
+  int operand;
+};
+
+/*
+ * The program, with the variables n (0), count (1), d (2) and the bound (3):
+ *   for(n = 2; n < bound; n++) { for(d = 2; d * d <= n && n % d != 0; d++) ; if(d * d > n) count++; }
+ */
+static const struct Instruction program[] = {
+  { PUSH, 2 }, { STORE, 0 },                                      /*  0: n = 2 */
+  { LOAD, 0 }, { LOAD, 3 }, { LT, 0 }, { JZ, 35 },                /*  2: while(n < bound) */
+  { PUSH, 2 }, { STORE, 2 },                                      /*  6: d = 2 */
+  { LOAD, 0 }, { LOAD, 2 }, { LOAD, 2 }, { MUL, 0 }, { LT, 0 },   /*  8: n < d * d ? */
+  { PUSH, 1 }, { SUB, 0 }, { JZ, 26 },                            /* 13: then stop */
+  { LOAD, 0 }, { LOAD, 2 }, { MOD, 0 }, { JZ, 33 },               /* 16: n % d == 0: not prime */
+  { INC, 2 }, { JMP, 8 },                                         /* 20: d++ */
+  { HALT, 0 }, { HALT, 0 }, { HALT, 0 }, { HALT, 0 },             /* 22: unused */
+  { INC, 1 }, { JMP, 33 },                                        /* 26: count++ */
+  { HALT, 0 }, { HALT, 0 }, { HALT, 0 }, { HALT, 0 }, { HALT, 0 }, /* 28: unused */
+  { INC, 0 }, { JMP, 2 },                                         /* 33: n++ */
+  { LOAD, 1 }, { PRINT, 0 }, { HALT, 0 }                          /* 35: print count */
+};
+
+static int run(int bound) {
+  int stack[16], variables[4] = { 0, 0, 0, bound };
+  int sp = 0, pc = 0, result = 0;
+  for(;;) {
+    const struct Instruction *instruction = &program[pc++];
+    switch(instruction->opcode) {
+    case PUSH: stack[sp++] = instruction->operand; break;
+    case LOAD: stack[sp++] = variables[instruction->operand]; break;
+    case STORE: variables[instruction->operand] = stack[--sp]; break;
+    case ADD: sp--; stack[sp - 1] += stack[sp]; break;
+    case SUB: sp--; stack[sp - 1] -= stack[sp]; break;
+    case MUL: sp--; stack[sp - 1] *= stack[sp]; break;
+    case MOD: sp--; stack[sp - 1] %= stack[sp]; break;
+    case LT: sp--; stack[sp - 1] = stack[sp - 1] < stack[sp]; break;
+    case JZ: if(stack[--sp] == 0) pc = instruction->operand; break;
+    case JMP: pc = instruction->operand; break;
+    case INC: variables[instruction->operand]++; break;
+    case PRINT: result = stack[--sp]; break;
+    case HALT: return result;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int bound = argc > 1 ? atoi(argv[1]) : 400000;
+  printf("%d\n", run(bound));
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Nested loops: a blocked matrix multiplication followed by a stencil with a data dependent branch in its innermost loop.
+ * Usage: nestedLoops [repetitions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 128
+#define BLOCK 16
+
+static int a[N][N], b[N][N], c[N][N];
+
+static void multiply(void) {
+  for(int ii = 0; ii < N; ii += BLOCK)
+    for(int jj = 0; jj < N; jj += BLOCK)
+      for(int i = ii; i < ii + BLOCK; i++)
+        for(int j = jj; j < jj + BLOCK; j++) {
+          int sum = c[i][j];
+          for(int k = 0; k < N; k++)
+            sum += a[i][k] * b[k][j];
+          c[i][j] = sum;
+        }
+}
+
+static void stencil(void) {
+  for(int i = 1; i < N - 1; i++)
+    for(int j = 1; j < N - 1; j++) {
+      int v = a[i - 1][j] + a[i + 1][j] + a[i][j - 1] + a[i][j + 1];
+      if(v & 4)
+        a[i][j] = (v >> 2) ^ c[i][j];
+      else
+        a[i][j] = v - b[i][j];
+    }
+}
+
+int main(int argc, char **argv) {
+  int repetitions = argc > 1 ? atoi(argv[1]) : 600;
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++) {
+      a[i][j] = (i * 7 + j) & 15;
+      b[i][j] = (i + j * 3) & 15;
+      c[i][j] = 0;
+    }
+  for(int r = 0; r < repetitions; r++) {
+    multiply();
+    stencil();
+  }
+  unsigned checksum = 0;
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      checksum = checksum * 31 + (unsigned) c[i][j] + (unsigned) a[i][j];
+  printf("%u\n", checksum);
+  return 0;
+}
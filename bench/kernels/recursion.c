@@ -0,0 +1,51 @@
+/*
+ * Recursion: the naive Fibonacci recursion, and the recursive construction, traversal and destruction of binary trees.
+ * Usage: recursion [depth]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Node {
+  struct Node *left, *right;
+  int value;
+};
+
+static int fibonacci(int n) {
+  return n < 2 ? n : fibonacci(n - 1) + fibonacci(n - 2);
+}
+
+static struct Node *build(int depth, int value) {
+  struct Node *node = malloc(sizeof(struct Node));
+  node->value = value;
+  node->left = depth > 0 ? build(depth - 1, 2 * value) : NULL;
+  node->right = depth > 0 ? build(depth - 1, 2 * value + 1) : NULL;
+  return node;
+}
+
+static unsigned sum(const struct Node *node) {
+  if(!node)
+    return 0;
+  unsigned value = node->value & 1 ? (unsigned) node->value * 3 : (unsigned) node->value;
+  return value + sum(node->left) + sum(node->right);
+}
+
+static void release(struct Node *node) {
+  if(!node)
+    return;
+  release(node->left);
+  release(node->right);
+  free(node);
+}
+
+int main(int argc, char **argv) {
+  int depth = argc > 1 ? atoi(argv[1]) : 19;
+  unsigned checksum = fibonacci(depth + 12);
+  for(int i = 0; i < 8; i++) {
+    struct Node *tree = build(depth, 1);
+    checksum = checksum * 31 + sum(tree);
+    release(tree);
+  }
+  printf("%u\n", checksum);
+  return 0;
+}
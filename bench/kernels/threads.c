@@ -0,0 +1,60 @@
+/*
+ * Multithreaded loops: every thread runs a histogram and a prefix sum over its own slice of a shared array. The work of every thread does not
+ * depend on the scheduling, so the counts are the same from run to run.
+ * Usage: threads [iterations] [threads]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 64
+#define SLICE 4096
+
+static unsigned data[MAX_THREADS * SLICE];
+static unsigned results[MAX_THREADS];
+static int iterations;
+
+static void *work(void *argument) {
+  int thread = (int) (long) argument;
+  unsigned *slice = &data[thread * SLICE];
+  unsigned histogram[16] = { 0 };
+  for(int i = 0; i < SLICE; i++)
+    slice[i] = (unsigned) (i * 2654435761u) ^ (unsigned) thread;
+  for(int r = 0; r < iterations; r++) {
+    for(int i = 0; i < SLICE; i++) {
+      unsigned v = slice[i];
+      if(v & 1)
+        histogram[v >> 28]++;
+      else
+        histogram[(v >> 4) & 15] += 2;
+    }
+    unsigned prefix = 0;
+    for(int i = 0; i < SLICE; i++) {
+      prefix += slice[i];
+      slice[i] = prefix ^ histogram[i & 15];
+    }
+  }
+  unsigned result = 0;
+  for(int i = 0; i < 16; i++)
+    result = result * 31 + histogram[i];
+  results[thread] = result;
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  iterations = argc > 1 ? atoi(argv[1]) : 8000;
+  int numThreads = argc > 2 ? atoi(argv[2]) : 4;
+  if(numThreads < 1 || numThreads > MAX_THREADS)
+    numThreads = 4;
+  pthread_t threads[MAX_THREADS];
+  for(int t = 0; t < numThreads; t++)
+    pthread_create(&threads[t], NULL, work, (void *) (long) t);
+  unsigned checksum = 0;
+  for(int t = 0; t < numThreads; t++) {
+    pthread_join(threads[t], NULL);
+    checksum = checksum * 31 + results[t];
+  }
+  printf("%u\n", checksum);
+  return 0;
+}
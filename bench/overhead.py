@@ -0,0 +1,268 @@
+#!/usr/bin/env python
+#
+# Measures the cost and the accuracy of the instrumentation modes of the pass on the kernels of kernels/ (nested loops, a
+# switch based interpreter, recursion and multithreaded loops) and on a large function generated by genCFG.py. Every
+# kernel is compiled natively (-O2) without instrumentation and once per mode, the instrumentation running on the -O0
+# bitcode before -O2 like the profile use pass expects. For every mode it prints:
+#   opt       the time opt takes to run the pass,
+#   slowdown  the best run time of the instrumented program over the best native run time,
+#   text      the growth of the text size of the program,
+#   counters  the size of the counter globals of the program (the thread local copies of -counter-mode=sharded
+#             are counted once, and the calling context tree allocated at run time is not counted),
+#   counts    whether the block and edge counts of the binary profile are the same as with -counter-mode=atomic,
+#             or else their relative error (the sum of the differences over the sum of the counts), "-" for the
+#             modes without a binary profile (-coverage).
+# Run it from the bench directory after building the pass and the runtime (make in the parent directory). The
+# programs, logs and profiles are kept in out/.
+#
+# Usage: overhead.py [--modes mode,...] [--runs n] [--list] [kernel...] [-- opt options...]
+
+from __future__ import print_function
+
+import glob
+import os
+import platform
+import struct
+import subprocess
+import sys
+import time
+
+LLVM_HOME = os.path.expanduser("~/Workspace")
+BIN = os.path.join(LLVM_HOME, "llvm", "Release+Asserts", "bin")
+SHARED_LIB_EXT = "dylib" if platform.system() == "Darwin" else "so"
+PASS = "../../../../Release+Asserts/lib/CS201Profiling." + SHARED_LIB_EXT
+RUNTIME = "../../../../Release+Asserts/lib/libCS201ProfilingRuntime.a"
+OUT = "out"
+
+# The options of every mode. The atomic counters are the reference of the counts, since they are exact with threads.
+MODES = [
+    ("plain", []),
+    ("atomic", ["-counter-mode=atomic"]),
+    ("sharded", ["-counter-mode=sharded"]),
+    ("spanning-tree", ["-counter-mode=atomic", "-spanning-tree-counters"]),
+    ("no-paths", ["-counter-mode=atomic", "-path-profiling=false"]),
+    ("promoted", ["-counter-mode=atomic", "-promote-loop-counters"]),
+    ("sampling", ["-counter-mode=atomic", "-sampling"]),
+    ("mmap", ["-counter-mode=atomic", "-mmap-counters"]),
+    ("values", ["-counter-mode=atomic", "-value-profiling"]),
+    ("contexts", ["-counter-mode=atomic", "-calling-context"]),
+    ("timing", ["-counter-mode=atomic", "-timing"]),
+    ("memory", ["-counter-mode=atomic", "-memory-profiling"]),
+    ("coverage", ["-coverage"]),
+]
+REFERENCE = "atomic"
+
+# The prefixes of the counter globals made by the pass.
+COUNTER_PREFIXES = ["counters_", "chordCounter_", "pathCounter_", "pathKeys_", "pathOverflow_",
+                    "loopHistogram_", "siteValues_", "siteCounts_", "timeCounters_", "strideCounters_", "strides_",
+                    "coverage_", "__cs201_counters"]
+
+# The generated kernel: number of blocks of f and number of calls of f.
+GENERATED_BLOCKS = 3000
+GENERATED_CALLS = 20000
+
+# The CS201ProfileFormat.h layout.
+PROFILE_MAGIC = 0x4652503130325343
+PROFILE_VERSION = 2
+
+
+def run(command, **kwargs):
+    with open(os.devnull, "w") as devnull:
+        kwargs.setdefault("stdout", devnull)
+        return subprocess.call(command, **kwargs)
+
+
+def check(command, log=None):
+    if log is None:
+        status = run(command)
+    else:
+        with open(log, "w") as output:
+            status = run(command, stdout=output, stderr=output)
+    if status != 0:
+        sys.stderr.write("error: %s failed%s\n" % (" ".join(command), "" if log is None else ", see " + log))
+        sys.exit(1)
+
+
+def tool(name):
+    path = os.path.join(BIN, name)
+    return path if os.path.exists(path) else name
+
+
+def kernels():
+    names = sorted(os.path.splitext(os.path.basename(path))[0] for path in glob.glob("kernels/*.c"))
+    return names + ["generated"]
+
+
+def source(kernel):
+    if kernel != "generated":
+        return os.path.join("kernels", kernel + ".c")
+    path = os.path.join(OUT, "generated.c")
+    with open(path, "w") as output:
+        subprocess.check_call([sys.executable, "genCFG.py", str(GENERATED_BLOCKS), "1", str(GENERATED_CALLS)], stdout=output)
+    return path
+
+
+def build(kernel, bitcode, mode, options):
+    """Instruments (unless mode is None), optimizes and links the bitcode of a kernel. Returns the program and the opt time."""
+    base = os.path.join(OUT, "%s.%s" % (kernel, mode or "native"))
+    seconds = None
+    if mode is None:
+        check([tool("opt"), "-O2", bitcode, "-o", base + ".bc"])
+    else:
+        start = time.time()
+        check([tool("opt"), "-load", PASS, "-pathProfiling"] + options + [bitcode, "-o", base + ".instr.bc"], log=base + ".log")
+        seconds = time.time() - start
+        check([tool("opt"), "-O2", base + ".instr.bc", "-o", base + ".bc"])
+    check([tool("llc"), "-O2", "-filetype=obj", base + ".bc", "-o", base + ".o"])
+    libraries = [] if mode is None else [RUNTIME]
+    check([tool("clang++"), base + ".o"] + libraries + ["-lpthread", "-o", base])
+    return base, seconds
+
+
+def measure(program, runs, profile):
+    """Runs a program runs times and returns its best time. The binary profile of the last run is left in profile."""
+    environment = dict(os.environ)
+    environment["CS201_PROFILE_FILE"] = profile
+    environment["CS201_COUNTERS_FILE"] = profile + ".counters"
+    environment["CS201_COVERAGE_FILE"] = profile + ".cov"
+    best = None
+    for _ in range(runs):
+        # The runtime adds the counts to an existing profile, so every run starts without one.
+        for path in [profile, profile + ".counters", profile + ".cov"]:
+            if os.path.exists(path):
+                os.remove(path)
+        start = time.time()
+        with open(os.devnull, "w") as devnull:
+            status = subprocess.call([program], env=environment, stdout=devnull, stderr=devnull)
+        seconds = time.time() - start
+        if status != 0:
+            sys.stderr.write("error: %s exited with status %d\n" % (program, status))
+            sys.exit(1)
+        best = seconds if best is None else min(best, seconds)
+    if os.path.exists(profile + ".counters"):
+        os.remove(profile + ".counters")
+    return best
+
+
+def textSize(program):
+    output = subprocess.check_output(["size", program]).decode().splitlines()
+    return int(output[1].split()[0])
+
+
+def counterSize(program):
+    total = 0
+    output = subprocess.check_output(["nm", "-S", program]).decode().splitlines()
+    for line in output:
+        fields = line.split()
+        if len(fields) == 4 and any(fields[3].lstrip("_").startswith(prefix.lstrip("_")) for prefix in COUNTER_PREFIXES):
+            total += int(fields[1], 16)
+    return total
+
+
+def readProfile(path):
+    """Returns the block and edge counts of a binary profile by function name, or None if there is no valid profile."""
+    if not os.path.exists(path):
+        return None
+    with open(path, "rb") as input:
+        data = input.read()
+    if len(data) < 24:
+        return None
+    magic, version, numFunctions, numCounts = struct.unpack_from("<QIIQ", data, 0)
+    if magic != PROFILE_MAGIC or version != PROFILE_VERSION:
+        return None
+    position = 24
+    records = []
+    for _ in range(numFunctions):
+        checksum, structuralHash, nameLength, numBlocks, numEdges, numPaths = struct.unpack_from("<QQIIII", data, position)
+        position += 32
+        name = data[position:position + nameLength].decode()
+        position += nameLength + numEdges * 8
+        position += (8 - nameLength % 8) % 8
+        position += numBlocks * 16
+        records.append((name, numBlocks, numEdges, numPaths))
+    counts = struct.unpack_from("<%dQ" % numCounts, data, position)
+    profile = {}
+    next = 0
+    for name, numBlocks, numEdges, numPaths in records:
+        profile[name] = counts[next:next + numBlocks + numEdges]
+        next += numBlocks + numEdges + numPaths
+    return profile
+
+
+def compare(profile, reference):
+    if profile is None or reference is None:
+        return "-"
+    difference = 0
+    total = 0
+    for name, expected in reference.items():
+        actual = profile.get(name, [0] * len(expected))
+        if len(actual) != len(expected):
+            return "mismatch"
+        difference += sum(abs(a - b) for a, b in zip(actual, expected))
+        total += sum(expected)
+    if difference == 0:
+        return "exact"
+    return "%.2f%%" % (100.0 * difference / max(total, 1))
+
+
+def main(arguments):
+    modes = [name for name, _ in MODES]
+    runs = 3
+    selected = []
+    extra = []
+    if "--" in arguments:
+        extra = arguments[arguments.index("--") + 1:]
+        arguments = arguments[:arguments.index("--")]
+    while arguments:
+        argument = arguments.pop(0)
+        if argument == "--modes":
+            modes = arguments.pop(0).split(",")
+        elif argument == "--runs":
+            runs = int(arguments.pop(0))
+        elif argument == "--list":
+            print("kernels: " + " ".join(kernels()))
+            print("modes:   " + " ".join(name for name, _ in MODES))
+            return 0
+        else:
+            selected.append(argument)
+    options = dict(MODES)
+    for mode in modes:
+        if mode not in options:
+            sys.stderr.write("error: unknown mode %s\n" % mode)
+            return 1
+    for kernel in selected:
+        if kernel not in kernels():
+            sys.stderr.write("error: unknown kernel %s\n" % kernel)
+            return 1
+    if REFERENCE not in modes:
+        modes.insert(0, REFERENCE)
+
+    if not os.path.isdir(OUT):
+        os.makedirs(OUT)
+    print("%-12s %-14s %8s %9s %8s %12s %10s" % ("kernel", "mode", "opt(s)", "slowdown", "text", "counters(B)", "counts"))
+    for kernel in selected or kernels():
+        bitcode = os.path.join(OUT, kernel + ".bc")
+        check([tool("clang"), "-O0", "-std=gnu99", "-emit-llvm", "-c", source(kernel), "-o", bitcode])
+        native, _ = build(kernel, bitcode, None, [])
+        nativeTime = measure(native, runs, native + ".prof")
+        nativeText = textSize(native)
+        print("%-12s %-14s %8s %8.3fs %8d %12s %10s" % (kernel, "native", "-", nativeTime, nativeText, "-", "-"))
+
+        # The reference is built first, so that the counts of the other modes can be compared with it.
+        reference = None
+        for mode in sorted(modes, key=lambda name: name != REFERENCE):
+            program, seconds = build(kernel, bitcode, mode, options[mode] + extra)
+            profile = program + ".prof"
+            best = measure(program, runs, profile)
+            counts = readProfile(profile)
+            if mode == REFERENCE:
+                reference = counts
+            growth = 100.0 * (textSize(program) - nativeText) / max(nativeText, 1)
+            print("%-12s %-14s %8.3f %8.2fx %+7.0f%% %12d %10s" % (kernel, mode, seconds, best / max(nativeTime, 1e-6), growth,
+                                                                   counterSize(program), compare(counts, reference)))
+            sys.stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -11,4 +11,4 @@ clang -emit-llvm support/${INPUT}.c -c -o support/${INPUT}.bc && \
     make && \
     ${LLVM_HOME}/llvm/Release+Asserts/bin/opt -load ../../../Release+Asserts/lib/CS201Profiling.${SHARED_LIB_EXT} -pathProfiling support/${INPUT}.bc -S -o support/${INPUT}.ll && \
     ${LLVM_HOME}/llvm/Release+Asserts/bin/llvm-as support/${INPUT}.ll -o support/${INPUT}.bb.bc && \
-    ${LLVM_HOME}/llvm/Release+Asserts/bin/lli support/${INPUT}.bb.bc
+    ${LLVM_HOME}/llvm/Release+Asserts/bin/lli -load=../../../Release+Asserts/lib/CS201ProfilingRuntime.${SHARED_LIB_EXT} support/${INPUT}.bb.bc
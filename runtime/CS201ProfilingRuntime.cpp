@@ -0,0 +1,1315 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+#include "CS201ProfilingRuntime.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+  // The registered modules, in the order of registration. Only the runtime changes the list, under the registration lock.
+  CS201ModuleDescriptor *firstModule = NULL;
+  CS201ModuleDescriptor *lastModule = NULL;
+  pthread_mutex_t registrationLock = PTHREAD_MUTEX_INITIALIZER;
+
+  // The live counters file, its header and its size, once a module with mapped counters is registered.
+  int countersFile = -1;
+  CS201CountersHeader *countersHeader = NULL;
+  uint64_t countersFileSize = 0;
+
+  // The state of the random generator of the sampling countdowns of the thread.
+  __thread uint32_t sampleSeed = 0;
+
+  // Serializes the updates of the value profiling tables which change their values, when the counters are shared between threads.
+  pthread_mutex_t valueLock = PTHREAD_MUTEX_INITIALIZER;
+
+  // A node of the calling context tree: a function called from a call site in the context of the parent node, with the block counters of the
+  // function in this context. The children of a node are chained through their next sibling, and new children are added at the head of the
+  // chain under the context lock, so the chains can be searched without it.
+  struct ContextNode {
+    ContextNode *parent;
+    ContextNode *firstChild;
+    ContextNode *nextSibling;
+    const CS201ContextFunction *function;
+    const CS201CallSite *site;
+    uint32_t depth;
+    uint64_t *counters;
+  };
+
+  // The size of the chunks of the pool the nodes and their counters are allocated from.
+  const size_t ContextChunkSize = 1 << 16;
+
+  // The roots of the calling context tree, the contexts of the functions entered without an instrumented caller, and the pool of its nodes.
+  ContextNode *contextRoots = NULL;
+  char *contextChunk = NULL;
+  size_t contextChunkUsed = 0;
+  pthread_mutex_t contextLock = PTHREAD_MUTEX_INITIALIZER;
+
+  // The current calling context of the thread and the call site of its next call.
+  __thread ContextNode *currentContext = NULL;
+  __thread const CS201CallSite *pendingCallSite = NULL;
+
+  // The times of a region accumulated by a thread since they were last added to the counters of the region, and the number of activations
+  // of the region on the timing stack of the thread. Only the outermost activation of a recursive region adds to its inclusive time.
+  struct TimingTotals {
+    uint64_t inclusive;
+    uint64_t exclusive;
+    uint32_t active;
+  };
+
+  // A region timed by a thread, a function or a loop: its counters and accumulated times, the timer when it was entered, the time spent in the
+  // functions it called and the number of regions timed while it ran, whose timer reads are part of its time.
+  struct TimingFrame {
+    uint64_t *counters;
+    TimingTotals *totals;
+    uint64_t start;
+    uint64_t calleeTime;
+    uint64_t nestedRegions;
+    bool function;
+  };
+
+  // The timing stack of a thread and its accumulated times by region.
+  struct TimingState {
+    vector<TimingFrame> frames;
+    unordered_map<uint64_t*, TimingTotals> totals;
+    // The time of the last region left, used by the calibration.
+    uint64_t lastElapsed;
+  };
+
+  // The timing state of the thread, and the key whose destructor adds the times of an exiting thread to the counters.
+  __thread TimingState *timingState = NULL;
+  pthread_once_t timingOnce = PTHREAD_ONCE_INIT;
+  pthread_key_t timingKey;
+
+  // The calibrated cost of the timer: the time measured for an empty region, and the time an empty region adds to the region around it.
+  uint64_t timerInnerCost = 0;
+  uint64_t timerRegionCost = 0;
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  const char *TimerUnit = "cycles";
+#else
+  const char *TimerUnit = "ns";
+#endif
+
+  // The key whose destructor merges the per thread counters of an exiting thread.
+  pthread_once_t threadKeyOnce = PTHREAD_ONCE_INIT;
+  pthread_key_t threadKey;
+
+  /*
+   * The following method merges the per thread counters of the calling thread into the global counters of every module.
+   */
+  void flushThread(void*) {
+
+    for(CS201ModuleDescriptor *module = firstModule; module; module = module->next) {
+      if(module->flushThread)
+        module->flushThread();
+    }
+  }
+
+  /*
+   * The following method creates the key of the per thread counters.
+   */
+  void createThreadKey() {
+
+    pthread_key_create(&threadKey, flushThread);
+  }
+
+  /*
+   * The following method returns the number the counters of a function are multiplied by to estimate its counts.
+   */
+  uint64_t getScale(const CS201FunctionDescriptor &function) {
+
+    return function.sampleInterval ? *function.sampleInterval : 1;
+  }
+
+  /*
+   * The following method returns an element of a block, edge or path counter array of a function.
+   */
+  uint64_t readCounter(const CS201FunctionDescriptor &function, const void *counters, uint64_t index) {
+
+    if(function.counterSize == sizeof(uint32_t))
+      return ((const uint32_t*) counters)[index];
+    return ((const uint64_t*) counters)[index];
+  }
+
+  /*
+   * The following method computes a count of a function from its counters.
+   */
+  uint64_t evaluateCount(const CS201FunctionDescriptor &function, unsigned count) {
+
+    int64_t sum = 0;
+    for(uint32_t t = function.countTermStart[count]; t < function.countTermStart[count + 1]; ++t) {
+      const CS201CountTerm &term = function.countTerms[t];
+      const void *counters = term.array == 0 ? function.blockCounters : function.edgeCounters;
+      sum += (int64_t) term.coefficient * (int64_t) readCounter(function, counters, term.index);
+    }
+    return (uint64_t) sum * getScale(function);
+  }
+
+  /*
+   * The following method warns about the functions of a module whose saturating counters reached their largest value. The counts computed from
+   * such a counter are wrong, the ones of the counter itself being a lower bound.
+   */
+  void checkSaturation(const CS201ModuleDescriptor *module) {
+
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(function.counterSize != sizeof(uint32_t))
+        continue;
+      bool saturated = false;
+      for(uint32_t t = 0; t < function.countTermStart[function.numBlocks + function.numEdges]; ++t) {
+        const CS201CountTerm &term = function.countTerms[t];
+        saturated |= readCounter(function, term.array == 0 ? function.blockCounters : function.edgeCounters, term.index) == UINT32_MAX;
+      }
+      for(uint32_t p = 0; p < function.numPaths; ++p)
+        saturated |= readCounter(function, function.pathCounters, p) == UINT32_MAX;
+      for(uint32_t slot = 0; slot < function.pathTableSize; ++slot)
+        saturated |= readCounter(function, function.pathTableCounters, slot) == UINT32_MAX;
+      if(saturated)
+        fprintf(stderr, "CS201Profiling: some counters of function %s saturated, its counts are not exact\n", function.name);
+    }
+  }
+
+  /*
+   * The following method prints the block and edge counts of the functions of a module.
+   */
+  void printBlockAndEdgeCounts(const CS201ModuleDescriptor *module) {
+
+    printf("\nBASIC BLOCK PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      printf("\n%s:\n", function.name);
+      for(uint32_t b = 0; b < function.numBlocks; ++b)
+        printf("%s: %llu\n", function.blockNames[b], (unsigned long long) evaluateCount(function, b));
+    }
+
+    printf("\nEDGE PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(function.numEdges > 0)
+        printf("\n%s:\n", function.name);
+      for(uint32_t e = 0; e < function.numEdges; ++e)
+        printf("%s -> %s: %llu\n", function.blockNames[function.edges[e].src], function.blockNames[function.edges[e].dst],
+               (unsigned long long) evaluateCount(function, function.numBlocks + e));
+    }
+  }
+
+  /*
+   * The following method prints the loops of the functions of a module: the number of entries and iterations of every loop, followed by the non
+   * empty buckets of its trip count histogram. The upper bound printed for the last bucket is the one of its first trip counts.
+   */
+  void printLoops(const CS201ModuleDescriptor *module) {
+
+    printf("\nLOOP PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(function.numLoops > 0)
+        printf("\n%s:\n", function.name);
+      for(uint32_t l = 0; l < function.numLoops; ++l) {
+        const CS201LoopDescriptor &loop = function.loops[l];
+        printf("%s: entries %llu, iterations %llu\n", loop.blocks, (unsigned long long) evaluateCount(function, function.numBlocks + function.numEdges + l),
+               (unsigned long long) evaluateCount(function, loop.header));
+        if(!function.loopHistogram)
+          continue;
+        const uint64_t *buckets = &function.loopHistogram[l * CS201_TRIP_COUNT_BUCKETS];
+        for(uint32_t b = 0; b < CS201_TRIP_COUNT_BUCKETS; ++b) {
+          if(buckets[b] != 0)
+            printf("  trip count %llu-%llu: %llu\n", 1ULL << b, (2ULL << b) - 1, (unsigned long long) buckets[b]);
+        }
+      }
+    }
+  }
+
+  /*
+   * The following method prints the call edges of the functions of a module, the number of calls made by every call site being the count of its block.
+   */
+  void printCallEdges(const CS201ModuleDescriptor *module) {
+
+    printf("\nCALL EDGES:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(function.numCallEdges > 0)
+        printf("\n%s:\n", function.name);
+      for(uint32_t c = 0; c < function.numCallEdges; ++c) {
+        const CS201CallEdge &edge = function.callEdges[c];
+        printf("%s -> %s: %llu\n", function.blockNames[edge.block], edge.callee ? edge.callee : "(indirect)",
+               (unsigned long long) evaluateCount(function, edge.block));
+      }
+    }
+  }
+
+  /*
+   * The following method prints the executed paths of the functions of a module: the blocks of every path of the functions with dense path
+   * counters, and the path numbers of the functions which count their paths in a hash table.
+   */
+  void printPaths(const CS201ModuleDescriptor *module) {
+
+    printf("\nPATH PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      uint64_t scale = getScale(function);
+      if(function.pathNames) {
+        printf("\n%s:\n", function.name);
+        for(uint32_t p = 0; p < function.numPaths; ++p) {
+          uint64_t counter = readCounter(function, function.pathCounters, p);
+          if(counter != 0)
+            printf("%s: %llu\n", function.pathNames[p], (unsigned long long) (counter * scale));
+        }
+      } else if(function.pathTableSize > 0) {
+        printf("\n%s:\n", function.name);
+        for(uint32_t slot = 0; slot < function.pathTableSize; ++slot) {
+          uint64_t counter = readCounter(function, function.pathTableCounters, slot);
+          if(counter != 0)
+            printf("path %llu: %llu\n", (unsigned long long) (function.pathKeys[slot] - 1), (unsigned long long) (counter * scale));
+        }
+        printf("other paths: %llu\n", (unsigned long long) (readCounter(function, function.pathOverflow, 0) * scale));
+      }
+    }
+  }
+
+  /*
+   * The following method prints the values counted at the value profiling sites of the functions of a module. The callees of indirect calls are
+   * printed by name when they are functions of the module whose address is taken, and as addresses otherwise.
+   */
+  void printValues(const CS201ModuleDescriptor *module) {
+
+    if(!(module->flags & CS201_MODULE_VALUE_PROFILING))
+      return;
+    uint32_t numSlots = module->numValueSlots;
+    printf("\nVALUE PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      uint64_t scale = getScale(function);
+      if(function.numValueSites > 0)
+        printf("\n%s:\n", function.name);
+      for(uint32_t i = 0; i < function.numValueSites; ++i) {
+        const CS201ValueSite &site = function.valueSites[i];
+        const uint64_t *values = &function.siteValues[i * numSlots];
+        const uint64_t *counts = &function.siteCounts[i * (numSlots + 1)];
+        printf("%s:\n", site.name);
+        for(uint32_t s = 0; s < numSlots; ++s) {
+          if(counts[s] == 0)
+            continue;
+          const char *name = NULL;
+          for(uint32_t c = 0; c < module->numCallees && site.kind == CS201_VALUE_CALLEE; ++c) {
+            if((uintptr_t) module->callees[c].address == values[s])
+              name = module->callees[c].name;
+          }
+          unsigned long long count = counts[s] * scale;
+          if(name)
+            printf("  %s: %llu\n", name, count);
+          else if(site.kind == CS201_VALUE_CALLEE)
+            printf("  0x%llx: %llu\n", (unsigned long long) values[s], count);
+          else
+            printf("  %lld: %llu\n", (long long) values[s], count);
+        }
+        if(counts[numSlots] != 0)
+          printf("  other: %llu\n", (unsigned long long) (counts[numSlots] * scale));
+      }
+    }
+  }
+
+  /*
+   * The following method prints the loads and stores of the blocks of the functions of a module which make any, followed by the counts of the
+   * stride classes of the loads and stores made inside loops, and the last stride of the sites which had a constant stride.
+   */
+  void printMemoryAccesses(const CS201ModuleDescriptor *module) {
+
+    if(!(module->flags & CS201_MODULE_MEMORY_PROFILING))
+      return;
+    printf("\nMEMORY PROFILING:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(!function.blockAccesses)
+        continue;
+      printf("\n%s:\n", function.name);
+      for(uint32_t b = 0; b < function.numBlocks; ++b) {
+        uint32_t loads = function.blockAccesses[2 * b], stores = function.blockAccesses[2 * b + 1];
+        if(loads == 0 && stores == 0)
+          continue;
+        uint64_t count = evaluateCount(function, b);
+        printf("%s: loads %llu, stores %llu\n", function.blockNames[b], (unsigned long long) (count * loads), (unsigned long long) (count * stores));
+      }
+      for(uint32_t i = 0; i < function.numMemorySites; ++i) {
+        const uint64_t *counts = &function.strideCounters[i * CS201_STRIDE_CLASSES];
+        printf("%s: first %llu, constant %llu, small %llu, irregular %llu", function.memorySites[i].name, (unsigned long long) counts[CS201_STRIDE_FIRST],
+               (unsigned long long) counts[CS201_STRIDE_CONSTANT], (unsigned long long) counts[CS201_STRIDE_SMALL],
+               (unsigned long long) counts[CS201_STRIDE_IRREGULAR]);
+        if(counts[CS201_STRIDE_CONSTANT] != 0)
+          printf(", last stride %lld", (long long) function.strides[i]);
+        printf("\n");
+      }
+    }
+  }
+
+  /*
+   * The following method prints the coverage of the functions of a module instrumented with -coverage: the number of covered blocks and edges of
+   * every function, followed by the blocks and edges which did not run.
+   */
+  void printCoverage(const CS201ModuleDescriptor *module) {
+
+    printf("\nCOVERAGE:\n");
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      const uint8_t *edgeFlags = function.coverage + function.numBlocks;
+      uint32_t coveredBlocks = 0, coveredEdges = 0;
+      for(uint32_t b = 0; b < function.numBlocks; ++b)
+        coveredBlocks += function.coverage[b] != 0;
+      for(uint32_t e = 0; e < function.numEdges; ++e)
+        coveredEdges += edgeFlags[e] != 0;
+      printf("\n%s: %u of %u blocks, %u of %u edges\n", function.name, coveredBlocks, function.numBlocks, coveredEdges, function.numEdges);
+      if(coveredBlocks < function.numBlocks) {
+        printf("not covered:");
+        for(uint32_t b = 0; b < function.numBlocks; ++b) {
+          if(!function.coverage[b])
+            printf(" %s", function.blockNames[b]);
+        }
+        printf("\n");
+      }
+      for(uint32_t e = 0; e < function.numEdges; ++e) {
+        if(!edgeFlags[e])
+          printf("not covered: %s -> %s\n", function.blockNames[function.edges[e].src], function.blockNames[function.edges[e].dst]);
+      }
+    }
+  }
+
+  /*
+   * The following method sets the sampling interval of the sampled functions of a module from the environment, if it is given there.
+   */
+  void setSampleInterval(CS201ModuleDescriptor *module) {
+
+    const char *value = getenv(CS201_SAMPLE_INTERVAL_ENV);
+    if(!value)
+      return;
+    long interval = atol(value);
+    if(interval < 1 || interval > 0x7fffffff) {
+      fprintf(stderr, "CS201Profiling: invalid sampling interval %s\n", value);
+      return;
+    }
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      if(module->functions[f].sampleInterval)
+        *module->functions[f].sampleInterval = interval;
+    }
+  }
+
+  /*
+   * The following method appends the bytes of a value to a buffer.
+   */
+  void appendBytes(vector<char> &buffer, const void *data, size_t size) {
+
+    buffer.insert(buffer.end(), (const char*) data, (const char*) data + size);
+  }
+
+  /*
+   * The following method appends the record of a function, its name, its edges and its block records to the descriptors of a binary profile or
+   * coverage file.
+   */
+  void appendFunctionRecord(vector<char> &descriptors, const CS201FunctionDescriptor &function, uint32_t numPaths) {
+
+    CS201FunctionRecord record;
+    record.checksum = function.checksum;
+    record.structuralHash = function.structuralHash;
+    record.nameLength = strlen(function.name);
+    record.numBlocks = function.numBlocks;
+    record.numEdges = function.numEdges;
+    record.numPaths = numPaths;
+    appendBytes(descriptors, &record, sizeof(record));
+    appendBytes(descriptors, function.name, record.nameLength);
+    appendBytes(descriptors, function.edges, function.numEdges * sizeof(CS201EdgeRecord));
+    descriptors.resize(descriptors.size() + (8 - record.nameLength % 8) % 8, 0);
+    for(uint32_t b = 0; b < function.numBlocks; ++b) {
+      CS201BlockRecord block;
+      block.hash = function.blockHashes[b];
+      block.line = function.blockLines[b];
+      block.reserved = 0;
+      appendBytes(descriptors, &block, sizeof(block));
+    }
+  }
+
+  /*
+   * The following method builds the binary profile of the modules which asked for it: the descriptors (everything up to the counts, see
+   * CS201ProfileFormat.h) and the counts.
+   */
+  void buildProfile(vector<char> &descriptors, vector<uint64_t> &counts) {
+
+    CS201ProfileHeader header;
+    header.magic = CS201_PROFILE_MAGIC;
+    header.version = CS201_PROFILE_VERSION;
+    header.numFunctions = 0;
+    header.numCounts = 0;
+    appendBytes(descriptors, &header, sizeof(header));
+
+    for(CS201ModuleDescriptor *module = firstModule; module; module = module->next) {
+      if(!(module->flags & CS201_MODULE_WRITE_PROFILE) || (module->flags & CS201_MODULE_COVERAGE))
+        continue;
+      for(uint32_t f = 0; f < module->numFunctions; ++f) {
+        const CS201FunctionDescriptor &function = module->functions[f];
+        appendFunctionRecord(descriptors, function, function.numPaths);
+        for(uint32_t c = 0; c < function.numBlocks + function.numEdges; ++c)
+          counts.push_back(evaluateCount(function, c));
+        for(uint32_t p = 0; p < function.numPaths; ++p)
+          counts.push_back(readCounter(function, function.pathCounters, p) * getScale(function));
+        header.numFunctions++;
+      }
+    }
+    header.numCounts = counts.size();
+    memcpy(&descriptors[0], &header, sizeof(header));
+  }
+
+  /*
+   * The following method builds the coverage file of the modules instrumented with -coverage which asked for it: the descriptors and the bitmap
+   * of their coverage flags (see CS201ProfileFormat.h).
+   */
+  void buildCoverage(vector<char> &descriptors, vector<char> &bitmap) {
+
+    CS201ProfileHeader header;
+    header.magic = CS201_COVERAGE_MAGIC;
+    header.version = CS201_COVERAGE_VERSION;
+    header.numFunctions = 0;
+    header.numCounts = 0;
+    appendBytes(descriptors, &header, sizeof(header));
+
+    for(CS201ModuleDescriptor *module = firstModule; module; module = module->next) {
+      if(!(module->flags & CS201_MODULE_WRITE_PROFILE) || !(module->flags & CS201_MODULE_COVERAGE))
+        continue;
+      for(uint32_t f = 0; f < module->numFunctions; ++f) {
+        const CS201FunctionDescriptor &function = module->functions[f];
+        appendFunctionRecord(descriptors, function, 0);
+        for(uint32_t i = 0; i < function.numBlocks + function.numEdges; ++i, ++header.numCounts) {
+          if(header.numCounts % 8 == 0)
+            bitmap.push_back(0);
+          if(function.coverage[i])
+            bitmap.back() |= 1 << header.numCounts % 8;
+        }
+        header.numFunctions++;
+      }
+    }
+    bitmap.resize((bitmap.size() + 7) / 8 * 8, 0);
+    memcpy(&descriptors[0], &header, sizeof(header));
+  }
+
+  /*
+   * The following method returns the name of a file given by an environment variable (or the default name), in which every "%p" is replaced by
+   * the process id.
+   */
+  string getFileName(const char *variable, const char *defaultName) {
+
+    const char *name = getenv(variable);
+    if(!name)
+      name = defaultName;
+    string path;
+    for(const char *c = name; *c; ++c) {
+      if(c[0] == '%' && c[1] == 'p') {
+        path += to_string(getpid());
+        ++c;
+      } else {
+        path += *c;
+      }
+    }
+    return path;
+  }
+
+  /*
+   * The following method returns unit i of the data of a binary profile (a count) or of a coverage file (a bit, see CS201ProfileFormat.h).
+   */
+  uint64_t getUnit(const char *data, uint64_t i, bool bits) {
+
+    if(bits)
+      return (data[i / 8] >> i % 8) & 1;
+    uint64_t count;
+    memcpy(&count, data + i * sizeof(uint64_t), sizeof(uint64_t));
+    return count;
+  }
+
+  /*
+   * The following method adds a value to unit i of the data of a binary profile or of a coverage file (where adding is setting the bit), growing
+   * the data by 8 bytes at a time as needed.
+   */
+  void addUnit(vector<char> &data, uint64_t i, uint64_t value, bool bits) {
+
+    size_t size = bits ? (i / 64 + 1) * 8 : (i + 1) * sizeof(uint64_t);
+    if(data.size() < size)
+      data.resize(size, 0);
+    if(bits) {
+      if(value)
+        data[i / 8] |= 1 << i % 8;
+      return;
+    }
+    uint64_t count = getUnit(&data[0], i, false) + value;
+    memcpy(&data[i * sizeof(uint64_t)], &count, sizeof(uint64_t));
+  }
+
+  // A function record of a binary profile or of a coverage file: its bytes in the descriptors and its units (counts or bits) in the data.
+  struct FileFunction {
+    string name;
+    uint64_t checksum;
+    size_t recordOffset;
+    size_t recordSize;
+    uint64_t firstUnit;
+    uint64_t numUnits;
+  };
+
+  /*
+   * The following method reads the function records of a binary profile or of a coverage file of size bytes, and the size of its descriptors.
+   * Returns false if the file is malformed.
+   */
+  bool readFileFunctions(const char *file, size_t size, bool bits, vector<FileFunction> &functions, size_t &descriptorsSize) {
+
+    CS201ProfileHeader header;
+    if(size < sizeof(header))
+      return false;
+    memcpy(&header, file, sizeof(header));
+    size_t position = sizeof(header);
+    uint64_t nextUnit = 0;
+    for(uint32_t f = 0; f < header.numFunctions; ++f) {
+      CS201FunctionRecord record;
+      if(position + sizeof(record) > size)
+        return false;
+      memcpy(&record, file + position, sizeof(record));
+      size_t recordSize = sizeof(record) + record.nameLength + (size_t) record.numEdges * sizeof(CS201EdgeRecord);
+      recordSize += (8 - record.nameLength % 8) % 8 + (size_t) record.numBlocks * sizeof(CS201BlockRecord);
+      if(position + recordSize > size)
+        return false;
+      FileFunction function;
+      function.name.assign(file + position + sizeof(record), record.nameLength);
+      function.checksum = record.checksum;
+      function.recordOffset = position;
+      function.recordSize = recordSize;
+      function.firstUnit = nextUnit;
+      function.numUnits = (uint64_t) record.numBlocks + record.numEdges + record.numPaths;
+      functions.push_back(function);
+      nextUnit += function.numUnits;
+      position += recordSize;
+    }
+    descriptorsSize = position;
+    uint64_t dataSize = bits ? (header.numCounts + 63) / 64 * 8 : header.numCounts * sizeof(uint64_t);
+    return nextUnit == header.numCounts && size - position >= dataSize;
+  }
+
+  /*
+   * The following method merges an existing binary profile or coverage file into new descriptors and data: the counts of a function are added to
+   * the new ones, and its coverage or'ed with the new one, if the program has a function of the same name and CFG checksum. The functions of the
+   * file which the program does not have are kept, so that the programs and runs which load different modules share a file, and the ones whose
+   * CFG changed since are dropped with a warning. A file which is not a profile of this version is replaced with a warning.
+   */
+  void mergeFile(const string &path, const vector<char> &old, vector<char> &descriptors, vector<char> &data, bool bits) {
+
+    CS201ProfileHeader header;
+    memcpy(&header, &descriptors[0], sizeof(header));
+    vector<FileFunction> oldFunctions;
+    size_t oldDescriptorsSize;
+    if(old.size() < sizeof(CS201ProfileHeader) || memcmp(&old[0], &descriptors[0], offsetof(CS201ProfileHeader, numFunctions)) != 0 ||
+       !readFileFunctions(&old[0], old.size(), bits, oldFunctions, oldDescriptorsSize)) {
+      fprintf(stderr, "CS201Profiling: %s is not a %s of this version, it is replaced\n", path.c_str(), bits ? "coverage file" : "profile");
+      return;
+    }
+    const char *oldData = &old[oldDescriptorsSize];
+
+    // The same descriptors have the same units.
+    if(oldDescriptorsSize == descriptors.size() && memcmp(&old[0], &descriptors[0], descriptors.size()) == 0) {
+      for(uint64_t i = 0; i < header.numCounts; ++i)
+        addUnit(data, i, getUnit(oldData, i, bits), bits);
+      return;
+    }
+
+    // The new descriptors are followed by the new data in the file written.
+    vector<FileFunction> functions;
+    size_t descriptorsSize;
+    vector<char> file(descriptors);
+    file.insert(file.end(), data.begin(), data.end());
+    readFileFunctions(&file[0], file.size(), bits, functions, descriptorsSize);
+    set<string> names;
+    for(const FileFunction &function: functions)
+      names.insert(function.name);
+    multimap<pair<string, uint64_t>, size_t> functionIds;
+    for(size_t f = 0; f < functions.size(); ++f)
+      functionIds.insert(make_pair(make_pair(functions[f].name, functions[f].checksum), f));
+    vector<bool> merged(functions.size(), false);
+    for(const FileFunction &oldFunction: oldFunctions) {
+      auto range = functionIds.equal_range(make_pair(oldFunction.name, oldFunction.checksum));
+      auto it = range.first;
+      while(it != range.second && (merged[it->second] || functions[it->second].numUnits != oldFunction.numUnits))
+        ++it;
+      if(it != range.second) {
+        const FileFunction &function = functions[it->second];
+        merged[it->second] = true;
+        for(uint64_t u = 0; u < function.numUnits; ++u)
+          addUnit(data, function.firstUnit + u, getUnit(oldData, oldFunction.firstUnit + u, bits), bits);
+        continue;
+      }
+      if(names.count(oldFunction.name)) {
+        fprintf(stderr, "CS201Profiling: the CFG of %s changed, its data in %s is dropped\n", oldFunction.name.c_str(), path.c_str());
+        continue;
+      }
+      descriptors.insert(descriptors.end(), old.begin() + oldFunction.recordOffset, old.begin() + oldFunction.recordOffset + oldFunction.recordSize);
+      for(uint64_t u = 0; u < oldFunction.numUnits; ++u)
+        addUnit(data, header.numCounts + u, getUnit(oldData, oldFunction.firstUnit + u, bits), bits);
+      header.numFunctions++;
+      header.numCounts += oldFunction.numUnits;
+    }
+    memcpy(&descriptors[0], &header, sizeof(header));
+  }
+
+  /*
+   * The following method writes a file made of descriptors followed by data, a binary profile or a coverage file (bits). The file is locked while
+   * it is read and written, so that the programs which exit at the same time merge their data one after the other. An existing file is merged into
+   * the new descriptors and data (see mergeFile).
+   */
+  void writeMergedFile(const string &path, vector<char> &descriptors, vector<char> &data, bool bits) {
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+      perror(path.c_str());
+      return;
+    }
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+      vector<char> old(st.st_size);
+      if(read(fd, &old[0], old.size()) == (ssize_t) old.size())
+        mergeFile(path, old, descriptors, data, bits);
+      else
+        perror(path.c_str());
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    if(ftruncate(fd, 0) != 0 || write(fd, &descriptors[0], descriptors.size()) != (ssize_t) descriptors.size() ||
+       (!data.empty() && write(fd, &data[0], data.size()) != (ssize_t) data.size()))
+      perror(path.c_str());
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+
+  /*
+   * The following method writes the binary profile file and the coverage file, when some module has data for them.
+   */
+  void writeProfile() {
+
+    vector<char> descriptors;
+    vector<uint64_t> counts;
+    buildProfile(descriptors, counts);
+    if(!counts.empty() || descriptors.size() != sizeof(CS201ProfileHeader)) {
+      vector<char> data((const char*) counts.data(), (const char*) (counts.data() + counts.size()));
+      writeMergedFile(getFileName(CS201_PROFILE_FILE_ENV, CS201_PROFILE_FILE_DEFAULT), descriptors, data, false);
+    }
+
+    vector<char> coverageDescriptors, bitmap;
+    buildCoverage(coverageDescriptors, bitmap);
+    if(coverageDescriptors.size() != sizeof(CS201ProfileHeader))
+      writeMergedFile(getFileName(CS201_COVERAGE_FILE_ENV, CS201_COVERAGE_FILE_DEFAULT), coverageDescriptors, bitmap, true);
+  }
+
+  /*
+   * The following method appends a value to a buffer and pads the buffer to a multiple of 8 bytes.
+   */
+  void appendPadded(vector<char> &buffer, const void *data, size_t size) {
+
+    appendBytes(buffer, data, size);
+    buffer.resize((buffer.size() + 7) / 8 * 8, 0);
+  }
+
+  /*
+   * The following method creates the live counters file and maps its header. Returns false if this is not possible.
+   */
+  bool createCountersFile() {
+
+    string path = getFileName(CS201_COUNTERS_FILE_ENV, CS201_COUNTERS_FILE_DEFAULT);
+    countersFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(countersFile < 0 || ftruncate(countersFile, CS201_COUNTERS_PAGE_SIZE) != 0) {
+      perror(path.c_str());
+      return false;
+    }
+    void *header = mmap(NULL, CS201_COUNTERS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, countersFile, 0);
+    if(header == MAP_FAILED) {
+      perror(path.c_str());
+      close(countersFile);
+      countersFile = -1;
+      return false;
+    }
+    countersHeader = (CS201CountersHeader*) header;
+    countersHeader->magic = CS201_COUNTERS_MAGIC;
+    countersHeader->version = CS201_COUNTERS_VERSION;
+    countersHeader->pageSize = CS201_COUNTERS_PAGE_SIZE;
+    countersHeader->pid = getpid();
+    countersHeader->numModules = 0;
+    countersFileSize = CS201_COUNTERS_PAGE_SIZE;
+    return true;
+  }
+
+  /*
+   * The following method maps the counters of a module from the live counters file. The description of the module and the current value of its
+   * counters are appended to the file, and the counter region of the module is then replaced by a shared mapping of the appended counters.
+   * Counts added by other threads while this is done may be lost, which only matters for modules loaded while the program runs.
+   */
+  void mapCounters(CS201ModuleDescriptor *module) {
+
+    if(module->numRegions != 1 || module->regions[0].size == 0)
+      return;
+    char *start = (char*) module->regions[0].start;
+    uint64_t size = module->regions[0].size;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if(pageSize <= 0 || CS201_COUNTERS_PAGE_SIZE % pageSize != 0 || (uintptr_t) start % CS201_COUNTERS_PAGE_SIZE != 0 ||
+       size % CS201_COUNTERS_PAGE_SIZE != 0) {
+      fprintf(stderr, "CS201Profiling: the counters of module %s can not be mapped\n", module->name);
+      return;
+    }
+    if(!countersHeader && (countersFile >= 0 || !createCountersFile()))
+      return;
+
+    // The counter offsets are computed relative to the start of the counters, and moved to the file offset of the counters at the end.
+    vector<char> description;
+    vector<size_t> offsetPositions;
+    CS201CountersModule record;
+    record.countersOffset = 0;
+    record.countersSize = size;
+    record.numFunctions = module->numFunctions;
+    record.nameLength = strlen(module->name);
+    // The pass gives all the functions of a module counters of the same size.
+    record.counterSize = module->numFunctions > 0 ? module->functions[0].counterSize : sizeof(uint64_t);
+    record.reserved = 0;
+    appendBytes(description, &record, sizeof(record));
+    appendPadded(description, module->name, record.nameLength);
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      CS201CountersFunction functionRecord;
+      functionRecord.checksum = function.checksum;
+      functionRecord.nameLength = strlen(function.name);
+      functionRecord.numBlocks = function.numBlocks;
+      functionRecord.numEdges = function.numEdges;
+      functionRecord.numPaths = function.numPaths;
+      functionRecord.pathsOffset = function.numPaths > 0 ? (char*) function.pathCounters - start : 0;
+      functionRecord.scale = getScale(function);
+      functionRecord.reserved = 0;
+      if(function.numPaths > 0)
+        offsetPositions.push_back(description.size() + offsetof(CS201CountersFunction, pathsOffset));
+      appendBytes(description, &functionRecord, sizeof(functionRecord));
+      appendPadded(description, function.name, functionRecord.nameLength);
+      appendBytes(description, function.edges, function.numEdges * sizeof(CS201EdgeRecord));
+      uint32_t numCounts = function.numBlocks + function.numEdges;
+      appendPadded(description, function.countTermStart, (numCounts + 1) * sizeof(uint32_t));
+      for(uint32_t t = 0; t < function.countTermStart[numCounts]; ++t) {
+        const CS201CountTerm &term = function.countTerms[t];
+        char *counters = (char*) (term.array == 0 ? function.blockCounters : function.edgeCounters);
+        CS201CountersTerm fileTerm;
+        fileTerm.offset = counters + term.index * function.counterSize - start;
+        fileTerm.coefficient = term.coefficient;
+        offsetPositions.push_back(description.size() + offsetof(CS201CountersTerm, offset));
+        appendBytes(description, &fileTerm, sizeof(fileTerm));
+      }
+    }
+
+    uint64_t descriptionOffset = countersFileSize;
+    uint64_t countersOffset = (descriptionOffset + description.size() + CS201_COUNTERS_PAGE_SIZE - 1) / CS201_COUNTERS_PAGE_SIZE * CS201_COUNTERS_PAGE_SIZE;
+    memcpy(&description[offsetof(CS201CountersModule, countersOffset)], &countersOffset, sizeof(uint64_t));
+    for(size_t i = 0; i < offsetPositions.size(); ++i) {
+      uint64_t offset;
+      memcpy(&offset, &description[offsetPositions[i]], sizeof(uint64_t));
+      offset += countersOffset;
+      memcpy(&description[offsetPositions[i]], &offset, sizeof(uint64_t));
+    }
+
+    if(ftruncate(countersFile, countersOffset + size) != 0 ||
+       pwrite(countersFile, &description[0], description.size(), descriptionOffset) != (ssize_t) description.size() ||
+       pwrite(countersFile, start, size, countersOffset) != (ssize_t) size) {
+      perror("CS201Profiling: live counters file");
+      return;
+    }
+    if(mmap(start, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, countersFile, countersOffset) == MAP_FAILED) {
+      // The private counters are left in place when the mapping fails, as MAP_FIXED only replaces them on success.
+      perror("CS201Profiling: live counters file");
+      return;
+    }
+    countersFileSize = countersOffset + size;
+    __sync_synchronize();
+    countersHeader->numModules++;
+  }
+
+  /*
+   * The following method counts a value in the table of a value profiling site, keeping its most frequent values with the Misra-Gries algorithm.
+   * A value of the table gets its count incremented and a new value takes a free slot. When the table is full the smallest count is decremented
+   * instead, freeing its slot when it reaches zero, and both the new value and the decremented one are added to the count of the other values.
+   * The counts of a site thus still add up to its executions, every value more frequent than one in numSlots + 1 is in the table, and the count
+   * of a value is a lower bound of its frequency. With atomic updates the counts are only approximate when several threads race on a site.
+   */
+  void countValue(uint64_t *values, uint64_t *counts, uint32_t numSlots, uint64_t value, bool atomic) {
+
+    uint32_t smallest = 0;
+    uint64_t smallestCount = UINT64_MAX;
+    for(uint32_t s = 0; s < numSlots; ++s) {
+      uint64_t count = __atomic_load_n(&counts[s], __ATOMIC_RELAXED);
+      if(count != 0 && __atomic_load_n(&values[s], __ATOMIC_RELAXED) == value) {
+        if(atomic)
+          __atomic_fetch_add(&counts[s], 1, __ATOMIC_RELAXED);
+        else
+          counts[s]++;
+        return;
+      }
+      if(count < smallestCount) {
+        smallest = s;
+        smallestCount = count;
+      }
+    }
+    if(numSlots == 0) {
+      counts[0] += 1;
+      return;
+    }
+    if(smallestCount == 0) {
+      __atomic_store_n(&values[smallest], value, __ATOMIC_RELAXED);
+      __atomic_store_n(&counts[smallest], 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if(atomic) {
+      __atomic_fetch_sub(&counts[smallest], 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&counts[numSlots], 2, __ATOMIC_RELAXED);
+    } else {
+      counts[smallest]--;
+      counts[numSlots] += 2;
+    }
+  }
+
+  /*
+   * The following method allocates zeroed memory from the pool of the calling context tree. Called under the context lock.
+   */
+  void *allocateContextMemory(size_t size) {
+
+    size = (size + 7) / 8 * 8;
+    if(!contextChunk || contextChunkUsed + size > ContextChunkSize) {
+      contextChunk = (char*) calloc(1, size > ContextChunkSize ? size : ContextChunkSize);
+      contextChunkUsed = 0;
+      if(!contextChunk) {
+        fprintf(stderr, "CS201Profiling: out of memory for the calling context tree\n");
+        abort();
+      }
+    }
+    void *memory = contextChunk + contextChunkUsed;
+    contextChunkUsed += size;
+    return memory;
+  }
+
+  /*
+   * The following method returns the child of a chain of nodes for a function and call site, or NULL.
+   */
+  ContextNode *findContext(ContextNode *const *children, const CS201ContextFunction *function, const CS201CallSite *site) {
+
+    for(ContextNode *node = __atomic_load_n(children, __ATOMIC_ACQUIRE); node; node = node->nextSibling) {
+      if(node->function == function && node->site == site)
+        return node;
+    }
+    return NULL;
+  }
+
+  /*
+   * The following method prints a calling context and its children: the call site and function of the context followed by the non zero
+   * block counts of the function in it, indented by the depth of the context.
+   */
+  void printContext(const ContextNode *node) {
+
+    string indent(2 * (node->depth - 1), ' ');
+    if(node->site)
+      printf("%s%s %s -> %s\n", indent.c_str(), node->site->caller, node->site->block, node->function->name);
+    else
+      printf("%s%s\n", indent.c_str(), node->function->name);
+    for(uint32_t b = 0; b < node->function->numBlocks; ++b) {
+      if(node->counters[b] != 0)
+        printf("%s  %s: %llu\n", indent.c_str(), node->function->blockNames[b], (unsigned long long) node->counters[b]);
+    }
+    for(const ContextNode *child = node->firstChild; child; child = child->nextSibling)
+      printContext(child);
+  }
+
+  /*
+   * The following method clears the counters of a calling context and its children.
+   */
+  void resetContext(ContextNode *node) {
+
+    for(; node; node = node->nextSibling) {
+      memset(node->counters, 0, node->function->numBlocks * sizeof(uint64_t));
+      resetContext(node->firstChild);
+    }
+  }
+
+  /*
+   * The following method reads the timer: the time stamp counter on x86 (rdtscp, which waits for the previous instructions to complete), the
+   * virtual counter on AArch64 and the monotonic clock in nanoseconds elsewhere.
+   */
+  inline uint64_t readTimer() {
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int processor;
+    return __builtin_ia32_rdtscp(&processor);
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value) : : "memory");
+    return value;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+  }
+
+  /*
+   * The following method returns the timing state of the calling thread, creating it the first time.
+   */
+  TimingState &getTimingState() {
+
+    if(!timingState) {
+      timingState = new TimingState();
+      pthread_setspecific(timingKey, timingState);
+    }
+    return *timingState;
+  }
+
+  /*
+   * The following method pushes a region on the timing stack of a thread and returns its depth. The timer is read last, so that the time of the
+   * region does not include the push.
+   */
+  uint32_t enterRegion(TimingState &state, uint64_t *counters, bool function) {
+
+    TimingTotals &totals = state.totals[counters];
+    totals.active++;
+    TimingFrame frame = { counters, &totals, 0, 0, 0, function };
+    state.frames.push_back(frame);
+    state.frames.back().start = readTimer();
+    return state.frames.size();
+  }
+
+  /*
+   * The following method pops the regions of a timing stack down to the given depth, all of them ending at the same timer read. The time of a region
+   * is its timer difference minus the cost of its own timer reads and of the ones of the regions timed inside it. The time of a function is added
+   * to the callee time of the regions of its caller, up to the caller itself, which subtract it from their exclusive time.
+   */
+  void exitRegions(TimingState &state, uint32_t depth, uint64_t now) {
+
+    while(depth > 0 && state.frames.size() >= depth) {
+      TimingFrame frame = state.frames.back();
+      state.frames.pop_back();
+      int64_t elapsed = (int64_t) (now - frame.start - timerInnerCost - frame.nestedRegions * timerRegionCost);
+      if(elapsed < 0)
+        elapsed = 0;
+      int64_t exclusive = elapsed - (int64_t) frame.calleeTime;
+      if(--frame.totals->active == 0)
+        frame.totals->inclusive += elapsed;
+      frame.totals->exclusive += exclusive > 0 ? exclusive : 0;
+      state.lastElapsed = elapsed;
+      if(state.frames.empty())
+        continue;
+      state.frames.back().nestedRegions += frame.nestedRegions + 1;
+      for(size_t i = state.frames.size(); frame.function && i-- > 0; ) {
+        state.frames[i].calleeTime += elapsed;
+        if(state.frames[i].function)
+          break;
+      }
+    }
+  }
+
+  /*
+   * The following method adds the times accumulated by a thread to the counters of their regions.
+   */
+  void flushTiming(TimingState &state) {
+
+    for(auto &region: state.totals) {
+      __atomic_fetch_add(&region.first[0], region.second.inclusive, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&region.first[1], region.second.exclusive, __ATOMIC_RELAXED);
+      region.second.inclusive = 0;
+      region.second.exclusive = 0;
+    }
+  }
+
+  /*
+   * The following method closes the open regions of an exiting thread and adds its times to the counters.
+   */
+  void finishThreadTiming(void *state) {
+
+    TimingState *threadState = (TimingState*) state;
+    exitRegions(*threadState, 1, readTimer());
+    flushTiming(*threadState);
+    delete threadState;
+    timingState = NULL;
+  }
+
+  /*
+   * The following method measures the cost of the timer with empty regions, keeping the smallest of many measures: the time of an empty region
+   * for timerInnerCost, and the time of a region holding many empty regions, less its own cost, per empty region for timerRegionCost.
+   */
+  void calibrateTimer() {
+
+    pthread_key_create(&timingKey, finishThreadTiming);
+    TimingState &state = getTimingState();
+    uint64_t counters[2];
+    uint64_t innerCost = UINT64_MAX;
+    for(int i = 0; i < 1000; ++i) {
+      uint32_t depth = enterRegion(state, counters, true);
+      exitRegions(state, depth, readTimer());
+      innerCost = min(innerCost, state.lastElapsed);
+    }
+    timerInnerCost = innerCost;
+    const int NumRegions = 100;
+    uint64_t regionCost = UINT64_MAX;
+    for(int i = 0; i < 100; ++i) {
+      uint32_t depth = enterRegion(state, counters, true);
+      for(int r = 0; r < NumRegions; ++r) {
+        uint32_t inner = enterRegion(state, counters + 1, false);
+        exitRegions(state, inner, readTimer());
+      }
+      exitRegions(state, depth, readTimer());
+      regionCost = min(regionCost, state.lastElapsed / NumRegions);
+    }
+    timerRegionCost = regionCost;
+    state.totals.clear();
+  }
+
+  /*
+   * The following method prints the inclusive and exclusive times of the functions of a module and of their loops.
+   */
+  void printTimes(const CS201ModuleDescriptor *module) {
+
+    if(!(module->flags & CS201_MODULE_TIMING))
+      return;
+    printf("\nTIME PROFILING (%s, %llu subtracted per region):\n", TimerUnit, (unsigned long long) timerInnerCost);
+    for(uint32_t f = 0; f < module->numFunctions; ++f) {
+      const CS201FunctionDescriptor &function = module->functions[f];
+      if(!function.timeCounters)
+        continue;
+      printf("\n%s: inclusive %llu, exclusive %llu\n", function.name, (unsigned long long) function.timeCounters[0],
+             (unsigned long long) function.timeCounters[1]);
+      for(uint32_t l = 0; l < function.numLoops; ++l)
+        printf("%s: inclusive %llu, exclusive %llu\n", function.loops[l].blocks, (unsigned long long) function.timeCounters[2 * (l + 1)],
+               (unsigned long long) function.timeCounters[2 * (l + 1) + 1]);
+    }
+  }
+
+  /*
+   * The following method dumps the profile when the program exits, and writes the binary profile file and the coverage file. The regions of the
+   * calling thread which are still open, when exit is called from inside them, are closed first.
+   */
+  void dumpAtExit() {
+
+    if(timingState)
+      exitRegions(*timingState, 1, readTimer());
+    __cs201_dump();
+    writeProfile();
+  }
+}
+
+/*
+ * The following method adds a module to the registered modules. The first registration installs the exit hook which dumps the profile.
+ * The counters of a module with mapped counters are moved to the live counters file.
+ */
+void __cs201_register_module(CS201ModuleDescriptor *module) {
+
+  if(module->version != CS201_RUNTIME_VERSION) {
+    fprintf(stderr, "CS201Profiling: module %s was instrumented for another version of the runtime, it is not profiled\n", module->name);
+    return;
+  }
+  setSampleInterval(module);
+  pthread_mutex_lock(&registrationLock);
+  module->next = NULL;
+  if(lastModule)
+    lastModule->next = module;
+  else
+    atexit(dumpAtExit);
+  if(!firstModule)
+    firstModule = module;
+  lastModule = module;
+  if(module->flags & CS201_MODULE_MAPPED_COUNTERS)
+    mapCounters(module);
+  pthread_mutex_unlock(&registrationLock);
+}
+
+/*
+ * The following method sets the value of the thread key for the calling thread, so that the key destructor merges its counters when it exits.
+ */
+void __cs201_register_thread(void) {
+
+  pthread_once(&threadKeyOnce, createThreadKey);
+  pthread_setspecific(threadKey, (void*) 1);
+}
+
+/*
+ * The following method prints the profile of all the registered modules. The files are only written at exit, since they are merged with the
+ * existing ones and the counts would otherwise be added once per dump.
+ * The counters of the calling thread are merged first, as the exit of the main thread does not run the thread key destructors.
+ */
+void __cs201_dump(void) {
+
+  flushThread(NULL);
+  if(timingState)
+    flushTiming(*timingState);
+  for(CS201ModuleDescriptor *module = firstModule; module; module = module->next) {
+    if(module->flags & CS201_MODULE_COVERAGE) {
+      printCoverage(module);
+      continue;
+    }
+    checkSaturation(module);
+    printBlockAndEdgeCounts(module);
+    printLoops(module);
+    printCallEdges(module);
+    printPaths(module);
+    printValues(module);
+    printTimes(module);
+    printMemoryAccesses(module);
+  }
+  if(contextRoots) {
+    printf("\nCALLING CONTEXT TREE:\n\n");
+    for(const ContextNode *root = contextRoots; root; root = root->nextSibling)
+      printContext(root);
+  }
+}
+
+/*
+ * The following method clears all the counters of the registered modules.
+ */
+void __cs201_reset(void) {
+
+  for(CS201ModuleDescriptor *module = firstModule; module; module = module->next) {
+    for(uint32_t r = 0; r < module->numRegions; ++r)
+      memset(module->regions[r].start, 0, module->regions[r].size);
+  }
+  pthread_mutex_lock(&contextLock);
+  resetContext(contextRoots);
+  pthread_mutex_unlock(&contextLock);
+  if(timingState) {
+    for(auto &region: timingState->totals) {
+      region.second.inclusive = 0;
+      region.second.exclusive = 0;
+    }
+  }
+}
+
+/*
+ * The following method counts a value at a value profiling site of a module whose counters are plain.
+ */
+void __cs201_profile_value(uint64_t *values, uint64_t *counts, uint32_t numSlots, uint64_t value) {
+
+  countValue(values, counts, numSlots, value, false);
+}
+
+/*
+ * The following method counts a value at a value profiling site of a module whose counters are shared between threads. The value is first looked up
+ * without the lock, as most executions of a site find their value in the table.
+ */
+void __cs201_profile_value_atomic(uint64_t *values, uint64_t *counts, uint32_t numSlots, uint64_t value) {
+
+  for(uint32_t s = 0; s < numSlots; ++s) {
+    if(__atomic_load_n(&counts[s], __ATOMIC_RELAXED) != 0 && __atomic_load_n(&values[s], __ATOMIC_RELAXED) == value) {
+      __atomic_fetch_add(&counts[s], 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+  pthread_mutex_lock(&valueLock);
+  countValue(values, counts, numSlots, value, true);
+  pthread_mutex_unlock(&valueLock);
+}
+
+/*
+ * The following method draws the number of checks until the next sample with a xorshift generator. The mean is the interval, so the counters times
+ * the interval still estimate the counts.
+ */
+uint32_t __cs201_next_sample(uint32_t interval) {
+
+  if(interval <= 1)
+    return 1;
+  uint32_t x = sampleSeed;
+  if(x == 0)
+    x = ((uint32_t) (uintptr_t) &sampleSeed ^ (uint32_t) getpid() ^ 0x9e3779b9) | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sampleSeed = x;
+  return 1 + x % (2 * interval - 1);
+}
+
+/*
+ * The following method finds the calling context of a function entered from the pending call site of the current context, creating it the first
+ * time. The calls made in a context at the largest depth are found among the children of its parent, which cuts the deeper contexts.
+ */
+uint64_t *__cs201_cct_enter(const CS201ContextFunction *function, uint32_t maxDepth, void **previous) {
+
+  ContextNode *parent = currentContext;
+  const CS201CallSite *site = pendingCallSite;
+  *previous = parent;
+  pendingCallSite = NULL;
+  while(parent && parent->depth >= maxDepth)
+    parent = parent->parent;
+  ContextNode **children = parent ? &parent->firstChild : &contextRoots;
+
+  ContextNode *node = findContext(children, function, site);
+  if(!node) {
+    pthread_mutex_lock(&contextLock);
+    node = findContext(children, function, site);
+    if(!node) {
+      node = (ContextNode*) allocateContextMemory(sizeof(ContextNode));
+      node->parent = parent;
+      node->nextSibling = *children;
+      node->function = function;
+      node->site = site;
+      node->depth = parent ? parent->depth + 1 : 1;
+      node->counters = (uint64_t*) allocateContextMemory(function->numBlocks * sizeof(uint64_t));
+      __atomic_store_n(children, node, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&contextLock);
+  }
+  currentContext = node;
+  return node->counters;
+}
+
+/*
+ * The following method restores the calling context of the caller of a function.
+ */
+void __cs201_cct_exit(void *previous) {
+
+  currentContext = (ContextNode*) previous;
+  pendingCallSite = NULL;
+}
+
+/*
+ * The following method records the call site of the next call, which the callee reads if it is profiled per calling context.
+ */
+void __cs201_cct_call(const CS201CallSite *site) {
+
+  pendingCallSite = site;
+}
+
+/*
+ * The following method enters a timed region. The timer is calibrated the first time a region is entered.
+ */
+uint32_t __cs201_time_enter(uint64_t *counters, uint32_t isFunction) {
+
+  pthread_once(&timingOnce, calibrateTimer);
+  return enterRegion(getTimingState(), counters, isFunction != 0);
+}
+
+/*
+ * The following method leaves a timed region, reading the timer once for all the regions it closes.
+ */
+void __cs201_time_exit(uint32_t depth) {
+
+  uint64_t now = readTimer();
+  if(timingState)
+    exitRegions(*timingState, depth, now);
+}
@@ -0,0 +1,252 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * Interface between the modules instrumented by the CS201Profiling pass and the profiling runtime library.
+ * Every instrumented module has a constant descriptor of its functions and counters, which a module constructor passes to
+ * __cs201_register_module. The runtime dumps the profile of all the registered modules when the program exits, printing the profiling
+ * data of every module from the names, edges, loops, call sites and value profiling sites of its descriptor, or its coverage.
+ * The pass builds these structures as IR constants, so their layout must be kept in sync with CS201Profiling.cpp.
+ */
+
+#ifndef CS201_PROFILING_RUNTIME_H
+#define CS201_PROFILING_RUNTIME_H
+
+#include <stdint.h>
+
+#include "../CS201ProfileFormat.h"
+
+#define CS201_RUNTIME_VERSION 12
+
+// The module asks for its counts to be written to the binary profile file.
+#define CS201_MODULE_WRITE_PROFILE 1
+// All the counters of the module are in its only counter region, which starts and ends on a page boundary (see CS201_COUNTERS_PAGE_SIZE).
+// The runtime maps the region from the live counters file (see CS201ProfileFormat.h).
+#define CS201_MODULE_MAPPED_COUNTERS 2
+// The module was instrumented with -value-profiling, so its profiling data has a value profiling section.
+#define CS201_MODULE_VALUE_PROFILING 4
+// The module was instrumented with -timing, so its profiling data has a time profiling section.
+#define CS201_MODULE_TIMING 8
+// The module was instrumented with -memory-profiling, so its profiling data has a memory profiling section.
+#define CS201_MODULE_MEMORY_PROFILING 16
+// The module was instrumented with -coverage: its functions only have coverage flags, which are printed and written to the coverage file
+// (see CS201ProfileFormat.h) instead of the profiling data and the binary profile.
+#define CS201_MODULE_COVERAGE 32
+
+// The environment variable which sets the sampling interval of the modules instrumented with -sampling.
+#define CS201_SAMPLE_INTERVAL_ENV "CS201_SAMPLE_INTERVAL"
+
+// The alignment of the counter region of a module with mapped counters. It is a multiple of the page sizes of the supported systems.
+#define CS201_COUNTERS_PAGE_SIZE 16384
+
+// The alignment of the counter arrays of a function, the size of a cache line, so that the counters of two functions never share a line.
+#define CS201_COUNTER_ALIGNMENT 64
+
+// The number of buckets of the trip count histogram of a loop. Bucket b counts the entries of the loop which ran its header 2^b to 2^(b+1) - 1 times,
+// and the last bucket every larger trip count.
+#define CS201_TRIP_COUNT_BUCKETS 32
+
+// The kinds of values counted at a value profiling site.
+#define CS201_VALUE_CALLEE 0
+#define CS201_VALUE_LENGTH 1
+#define CS201_VALUE_DIVISOR 2
+
+// The classes of the address strides of a load or store inside a loop, between consecutive iterations of its innermost loop: the first access of an
+// entry of the loop, which has no stride, the same stride as in the previous iteration, another stride of at most CS201_SMALL_STRIDE bytes either way,
+// and any other stride.
+#define CS201_STRIDE_FIRST 0
+#define CS201_STRIDE_CONSTANT 1
+#define CS201_STRIDE_SMALL 2
+#define CS201_STRIDE_IRREGULAR 3
+#define CS201_STRIDE_CLASSES 4
+#define CS201_SMALL_STRIDE 64
+
+// A term of a count: coefficient times element index of the block (array 0) or edge (array 1) counters of the function.
+struct CS201CountTerm {
+  uint32_t array;
+  uint32_t index;
+  int32_t coefficient;
+};
+
+// A natural loop of a function. Its number of iterations is the count of its header, and its number of entries is a count of its own (see
+// CS201FunctionDescriptor::countTermStart).
+struct CS201LoopDescriptor {
+  // The names of the blocks of the loop, each followed by a space.
+  const char *blocks;
+  uint32_t header;
+};
+
+// A call made by a function: the name of the callee, or NULL for an indirect call, and the block making it, whose count is the number of calls.
+struct CS201CallEdge {
+  const char *callee;
+  uint32_t block;
+};
+
+// A value profiling site of a function: the name its values are printed under and the kind of its values.
+struct CS201ValueSite {
+  const char *name;
+  uint32_t kind;
+};
+
+// A load or store inside a loop whose strides are profiled: the name its strides are printed under and its block.
+struct CS201MemorySite {
+  const char *name;
+  uint32_t block;
+};
+
+// A function of the module whose address is taken, so that the callees of the indirect calls can be printed by name.
+struct CS201Callee {
+  const void *address;
+  const char *name;
+};
+
+struct CS201FunctionDescriptor {
+  const char *name;
+  uint64_t checksum;
+  uint32_t numBlocks;
+  uint32_t numEdges;
+  // The number of dense path counters, zero if the paths of the function are not counted one by one.
+  uint32_t numPaths;
+  const struct CS201EdgeRecord *edges;
+  // The counter arrays of the function, of counterSize bytes per counter. The block counters are followed by the edge counters in one array.
+  // The edge counters are the chord counters with spanning tree placement, in which case there are no block counters.
+  void *blockCounters;
+  void *edgeCounters;
+  void *pathCounters;
+  // The count of block v is the sum of the terms [countTermStart[v], countTermStart[v + 1]), and the count of edge e the sum of the terms
+  // [countTermStart[numBlocks + e], countTermStart[numBlocks + e + 1]). The entries of loop l follow, at numBlocks + numEdges + l.
+  const uint32_t *countTermStart;
+  const struct CS201CountTerm *countTerms;
+  // The sampling interval if the counters are only updated in sampled executions, the counts being the counters times the interval, or NULL.
+  uint32_t *sampleInterval;
+  // The names of the blocks, by block id.
+  const char *const *blockNames;
+  uint32_t numLoops;
+  uint32_t numCallEdges;
+  const struct CS201LoopDescriptor *loops;
+  // The trip count histograms of the loops, CS201_TRIP_COUNT_BUCKETS 64 bit counters per loop, or NULL.
+  uint64_t *loopHistogram;
+  const struct CS201CallEdge *callEdges;
+  // The names of the dense paths, or NULL. The paths of a function with too many paths are counted in a hash table of pathTableSize slots, with
+  // the key (path number + 1) and the counter of every slot, and the paths which did not fit in it are counted in pathOverflow.
+  const char *const *pathNames;
+  uint64_t *pathKeys;
+  void *pathTableCounters;
+  void *pathOverflow;
+  uint32_t pathTableSize;
+  // The value profiling sites and their tables, with numValueSlots values and numValueSlots + 1 64 bit counts per site (see CS201ModuleDescriptor).
+  uint32_t numValueSites;
+  const struct CS201ValueSite *valueSites;
+  uint64_t *siteValues;
+  uint64_t *siteCounts;
+  // The inclusive and exclusive times of the function followed by the ones of every loop, or NULL (see __cs201_time_enter).
+  uint64_t *timeCounters;
+  // The number of loads and stores of every block (two numbers per block), or NULL, whose counts are the block count times these numbers. The
+  // stride profiling sites follow, with CS201_STRIDE_CLASSES 64 bit counters per site and the last stride of every site which had one when its
+  // loop was left.
+  const uint32_t *blockAccesses;
+  uint32_t numMemorySites;
+  const struct CS201MemorySite *memorySites;
+  uint64_t *strideCounters;
+  int64_t *strides;
+  // The coverage flags of the blocks followed by the ones of the edges, set to one when the block or edge ran, or NULL.
+  uint8_t *coverage;
+  // The identities of the blocks written to the binary profile (see CS201BlockRecord): the structural hash of the function and the hash and
+  // relative line of every block, by block id.
+  uint64_t structuralHash;
+  const uint64_t *blockHashes;
+  const uint32_t *blockLines;
+  // The size of the block, edge and path counters: 8 bytes, or 4 bytes for the 32 bit counters of -saturating-counters, which stop at UINT32_MAX.
+  uint32_t counterSize;
+};
+
+// A function profiled per calling context (-calling-context): its name and the names of its blocks, by block id.
+struct CS201ContextFunction {
+  const char *name;
+  uint32_t numBlocks;
+  const char *const *blockNames;
+};
+
+// A call site of a function profiled per calling context.
+struct CS201CallSite {
+  const char *caller;
+  const char *block;
+};
+
+// A piece of counter storage which is cleared by __cs201_reset.
+struct CS201CounterRegion {
+  void *start;
+  uint64_t size;
+};
+
+struct CS201ModuleDescriptor {
+  // Used by the runtime to chain the registered modules.
+  struct CS201ModuleDescriptor *next;
+  const char *name;
+  uint32_t version;
+  uint32_t flags;
+  uint32_t numFunctions;
+  uint32_t numRegions;
+  const struct CS201FunctionDescriptor *functions;
+  const struct CS201CounterRegion *regions;
+  // Merges the per thread counters of the calling thread into the global counters of the module, or NULL.
+  void (*flushThread)(void);
+  // The number of values in the table of a value profiling site, and the functions of the module whose address is taken.
+  uint32_t numValueSlots;
+  uint32_t numCallees;
+  const struct CS201Callee *callees;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Registers an instrumented module. Called by the constructor of the module.
+void __cs201_register_module(struct CS201ModuleDescriptor *module);
+
+// Makes the per thread counters of the calling thread be merged when it exits. Called the first time a thread runs instrumented code.
+void __cs201_register_thread(void);
+
+// Dumps the profile of all the registered modules: merges the per thread counters of the calling thread and prints the profiling data from the
+// descriptors. This is done automatically when the program exits, which also writes the binary profile file and the coverage file, once.
+void __cs201_dump(void);
+
+// Returns the number of checks until the next sample of the modules instrumented with -sampling, drawn at random between 1 and
+// 2 * interval - 1. Called when a sample is taken.
+uint32_t __cs201_next_sample(uint32_t interval);
+
+// Counts a value at a value profiling site, whose table has numSlots values and numSlots + 1 counts, the last one counting the values which are
+// not in the table. The atomic version is used when the counters are shared between threads.
+void __cs201_profile_value(uint64_t *values, uint64_t *counts, uint32_t numSlots, uint64_t value);
+void __cs201_profile_value_atomic(uint64_t *values, uint64_t *counts, uint32_t numSlots, uint64_t value);
+
+// Enters a function profiled per calling context: makes the context of the function, called from the last call site passed to __cs201_cct_call
+// in the current context, the current context of the thread. Contexts deeper than maxDepth are cut. Stores the previous context in *previous and
+// returns the 64 bit block counters of the new one.
+uint64_t *__cs201_cct_enter(const struct CS201ContextFunction *function, uint32_t maxDepth, void **previous);
+
+// Leaves a function profiled per calling context, restoring the context stored by __cs201_cct_enter.
+void __cs201_cct_exit(void *previous);
+
+// Records the call site of the next call of the thread.
+void __cs201_cct_call(const struct CS201CallSite *site);
+
+// Enters a timed region of the calling thread, a function (isFunction = 1) or a loop, whose times are added to counters[0] (inclusive) and counters[1]
+// (exclusive, without the time spent in the functions it called). Returns the depth of the region in the timing stack of the thread.
+uint32_t __cs201_time_enter(uint64_t *counters, uint32_t isFunction);
+
+// Leaves the timed region entered at the given depth, along with the regions entered after it which are still open.
+void __cs201_time_exit(uint32_t depth);
+
+// Clears all the counters of the registered modules and of the calling contexts. The per thread counters of the other running threads are not cleared.
+void __cs201_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
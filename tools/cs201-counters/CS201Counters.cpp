@@ -0,0 +1,246 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * cs201-counters prints the block, edge and path counts of a running program instrumented with -mmap-counters, by reading its live counters
+ * file (see CS201ProfileFormat.h). With -interval the counts are printed again every interval seconds, with the number of executions per second
+ * since the previous snapshot. With -reset the counters of the program are cleared.
+ */
+
+#include "../../CS201ProfileFormat.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<string> CountersFile(cl::Positional, cl::desc("<live counters file>"), cl::Required);
+
+static cl::opt<unsigned> Interval("interval", cl::desc("Print the counts every <n> seconds, with their rate since the previous snapshot"),
+                                  cl::value_desc("n"), cl::init(0));
+
+static cl::opt<bool> Reset("reset", cl::desc("Clear the counters of the program"), cl::init(false));
+
+namespace {
+
+  // The counts of a function in one snapshot, by block id, edge and path number.
+  struct FunctionCounts {
+    string name;
+    vector<CS201EdgeRecord> edges;
+    vector<uint64_t> blockCounts;
+    vector<uint64_t> edgeCounts;
+    vector<uint64_t> pathCounts;
+  };
+
+  /*
+   * The following method returns the counter at a file offset.
+   */
+  uint64_t readCounter(const char *file, uint64_t offset, uint32_t counterSize) {
+
+    if(counterSize == sizeof(uint64_t)) {
+      uint64_t value;
+      memcpy(&value, file + offset, sizeof(value));
+      return value;
+    }
+    uint32_t value;
+    memcpy(&value, file + offset, sizeof(value));
+    return value;
+  }
+
+  /*
+   * The following method maps the live counters file, writable if the counters are to be cleared. Returns NULL on failure.
+   */
+  char *mapFile(int fd, uint64_t &size) {
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CS201CountersHeader))
+      return NULL;
+    size = st.st_size;
+    void *file = mmap(NULL, size, Reset ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    return file == MAP_FAILED ? NULL : (char*) file;
+  }
+
+  /*
+   * The following method reads the counts of the complete modules of the file. If reset is true the counters are cleared as well.
+   * Returns false if the file is not a live counters file or is malformed: every record is checked against the size of the file, and every counter
+   * against the counter region of its module, before it is read.
+   */
+  bool readCounts(char *file, uint64_t size, vector<FunctionCounts> &functions, bool reset) {
+
+    CS201CountersHeader header;
+    memcpy(&header, file, sizeof(header));
+    if(header.magic != CS201_COUNTERS_MAGIC || header.version != CS201_COUNTERS_VERSION)
+      return false;
+
+    // Whether length bytes at a file offset are in the file.
+    auto fits = [&](uint64_t offset, uint64_t length) { return offset <= size && length <= size - offset; };
+
+    uint64_t position = header.pageSize;
+    for(uint32_t m = 0; m < header.numModules; ++m) {
+      CS201CountersModule module;
+      if(!fits(position, sizeof(module)))
+        return false;
+      memcpy(&module, file + position, sizeof(module));
+      if(!fits(module.countersOffset, module.countersSize) || (module.counterSize != sizeof(uint32_t) && module.counterSize != sizeof(uint64_t)))
+        return false;
+      // Whether the counter at a file offset is in the counter region of the module.
+      auto isCounter = [&](uint64_t offset) {
+        return offset >= module.countersOffset && module.counterSize <= module.countersSize &&
+               offset - module.countersOffset <= module.countersSize - module.counterSize;
+      };
+      position += sizeof(module) + (module.nameLength + 7) / 8 * 8;
+
+      for(uint32_t f = 0; f < module.numFunctions; ++f) {
+        CS201CountersFunction record;
+        if(!fits(position, sizeof(record)))
+          return false;
+        memcpy(&record, file + position, sizeof(record));
+        position += sizeof(record);
+        uint64_t namesAndEdges = (record.nameLength + 7) / 8 * 8 + (uint64_t) record.numEdges * sizeof(CS201EdgeRecord);
+        if(!fits(position, namesAndEdges))
+          return false;
+        FunctionCounts counts;
+        counts.name.assign(file + position, record.nameLength);
+        position += (record.nameLength + 7) / 8 * 8;
+        counts.edges.resize(record.numEdges);
+        if(record.numEdges > 0)
+          memcpy(&counts.edges[0], file + position, record.numEdges * sizeof(CS201EdgeRecord));
+        position += record.numEdges * sizeof(CS201EdgeRecord);
+
+        uint64_t numCounts = (uint64_t) record.numBlocks + record.numEdges;
+        uint64_t termStartSize = ((numCounts + 1) * sizeof(uint32_t) + 7) / 8 * 8;
+        if(!fits(position, termStartSize))
+          return false;
+        vector<uint32_t> termStart(numCounts + 1);
+        memcpy(&termStart[0], file + position, (numCounts + 1) * sizeof(uint32_t));
+        position += termStartSize;
+        for(uint64_t c = 0; c < numCounts; ++c) {
+          if(termStart[c] > termStart[c + 1])
+            return false;
+        }
+        if(termStart[0] != 0 || !fits(position, (uint64_t) termStart[numCounts] * sizeof(CS201CountersTerm)))
+          return false;
+        const char *terms = file + position;
+        position += (uint64_t) termStart[numCounts] * sizeof(CS201CountersTerm);
+
+        for(uint64_t c = 0; c < numCounts; ++c) {
+          int64_t sum = 0;
+          for(uint32_t t = termStart[c]; t < termStart[c + 1]; ++t) {
+            CS201CountersTerm term;
+            memcpy(&term, terms + (uint64_t) t * sizeof(term), sizeof(term));
+            if(!isCounter(term.offset))
+              return false;
+            sum += term.coefficient * (int64_t) readCounter(file, term.offset, module.counterSize);
+          }
+          (c < record.numBlocks ? counts.blockCounts : counts.edgeCounts).push_back((uint64_t) sum * record.scale);
+        }
+        if(record.numPaths > 0 && (!isCounter(record.pathsOffset) || (uint64_t) (record.numPaths - 1) * module.counterSize >
+                                   module.countersOffset + module.countersSize - module.counterSize - record.pathsOffset))
+          return false;
+        for(uint32_t p = 0; p < record.numPaths; ++p)
+          counts.pathCounts.push_back(readCounter(file, record.pathsOffset + (uint64_t) p * module.counterSize, module.counterSize) * record.scale);
+        functions.push_back(counts);
+      }
+
+      if(reset)
+        memset(file + module.countersOffset, 0, module.countersSize);
+      position = module.countersOffset + module.countersSize;
+    }
+    return true;
+  }
+
+  /*
+   * The following method prints a count, followed by its rate when there is a previous snapshot.
+   */
+  void printCount(uint64_t count, const vector<uint64_t> *previous, size_t index) {
+
+    outs() << count;
+    if(previous && index < previous->size() && count >= (*previous)[index])
+      outs() << " (" << (count - (*previous)[index]) / Interval << "/s)";
+    outs() << "\n";
+  }
+
+  /*
+   * The following method prints the counts of every function, with the rates since the previous snapshot if there is one.
+   */
+  void printCounts(const vector<FunctionCounts> &functions, const map<string, FunctionCounts> &previous) {
+
+    for(const FunctionCounts &function : functions) {
+      map<string, FunctionCounts>::const_iterator last = previous.find(function.name);
+      const FunctionCounts *lastCounts = last == previous.end() ? NULL : &last->second;
+      outs() << "\n" << function.name << ":\n";
+      outs() << "BASIC BLOCK PROFILING:\n";
+      for(size_t b = 0; b < function.blockCounts.size(); ++b) {
+        outs() << "b" << b << ": ";
+        printCount(function.blockCounts[b], lastCounts ? &lastCounts->blockCounts : NULL, b);
+      }
+      outs() << "EDGE PROFILING:\n";
+      for(size_t e = 0; e < function.edgeCounts.size(); ++e) {
+        outs() << "b" << function.edges[e].src << " -> b" << function.edges[e].dst << ": ";
+        printCount(function.edgeCounts[e], lastCounts ? &lastCounts->edgeCounts : NULL, e);
+      }
+      if(!function.pathCounts.empty()) {
+        outs() << "PATH PROFILING:\n";
+        for(size_t p = 0; p < function.pathCounts.size(); ++p) {
+          if(function.pathCounts[p] == 0)
+            continue;
+          outs() << "path " << p << ": ";
+          printCount(function.pathCounts[p], lastCounts ? &lastCounts->pathCounts : NULL, p);
+        }
+      }
+    }
+    outs().flush();
+  }
+}
+
+int main(int argc, char **argv) {
+
+  cl::ParseCommandLineOptions(argc, argv, "CS201 live counters reader\n");
+
+  int fd = open(CountersFile.c_str(), Reset ? O_RDWR : O_RDONLY);
+  if(fd < 0) {
+    perror(CountersFile.c_str());
+    return 1;
+  }
+
+  map<string, FunctionCounts> previous;
+  while(true) {
+    // The file grows when the program registers more modules, so it is mapped again for every snapshot.
+    uint64_t size;
+    char *file = mapFile(fd, size);
+    vector<FunctionCounts> functions;
+    if(!file || !readCounts(file, size, functions, Reset)) {
+      errs() << CountersFile << ": not a live counters file\n";
+      return 1;
+    }
+    munmap(file, size);
+    if(Reset)
+      break;
+
+    printCounts(functions, previous);
+    if(Interval == 0)
+      break;
+    previous.clear();
+    for(const FunctionCounts &function : functions)
+      previous[function.name] = function;
+    sleep(Interval);
+    outs() << "\n";
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,730 @@
+/*
+ * Authors:
+ * Sachin Shinde <sshin031@ucr.edu> : 861243251
+ * Nikhil Kamthe <nkamt001@ucr.edu> : 861245635
+ *
+ */
+
+/*
+ * cs201-profdata merges, compares and summarizes binary profiles (see CS201ProfileFormat.h), for instance the profiles of one program collected on
+ * many hosts.
+ *
+ *   cs201-profdata merge [-weighted-input=<weight>,<file>...] <file>... -o <output>
+ *   cs201-profdata diff <old profile> <new profile>
+ *   cs201-profdata report [-top=<n>] [-weighted-input=<weight>,<file>...] <file>...
+ *
+ * The inputs are read one at a time and only the merged counts are kept, so the memory used does not grow with the number of inputs. The functions
+ * are matched by name and CFG checksum like the runtime does, so the functions of the same name of different modules and the versions of a function
+ * whose CFG changed between the inputs are kept apart. Files with the same descriptors as the previous input (the usual case) are added without
+ * looking at their records. diff pairs the functions the same way and then compares the functions whose CFG changed by matching their blocks (see
+ * matchCS201Blocks).
+ */
+
+#include "../../CS201ProfileReader.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+using namespace std;
+
+namespace {
+
+  // A function of a merged profile, its counts starting at firstCount in the counts of the profile.
+  struct FunctionProfile {
+    string name;
+    uint64_t checksum;
+    uint64_t structuralHash;
+    uint32_t numBlocks;
+    uint32_t numPaths;
+    vector<CS201EdgeRecord> edges;
+    vector<CS201BlockRecord> blocks;
+    uint64_t firstCount;
+
+    uint64_t numCounts() const { return numBlocks + edges.size() + numPaths; }
+    // The lines of the blocks are not compared, since they move with the changes of the function which leave its CFG alone.
+    bool sameCFG(const FunctionProfile &other) const {
+      return checksum == other.checksum && structuralHash == other.structuralHash && numBlocks == other.numBlocks && numPaths == other.numPaths &&
+        edges.size() == other.edges.size() && (edges.empty() || memcmp(&edges[0], &other.edges[0], edges.size() * sizeof(CS201EdgeRecord)) == 0);
+    }
+  };
+
+  // Counts of an input file (from its count source) added to the merged counts (from count target).
+  struct CountRun {
+    uint64_t source;
+    uint64_t target;
+    uint64_t length;
+  };
+
+  /*
+   * The following method adds weight times length counts of an input file to merged counts. The counts of the file are 8 byte aligned since the
+   * file is mapped at a page boundary, and the loops are left simple so that the compiler vectorizes them.
+   */
+  void addCounts(uint64_t *target, const uint64_t *source, uint64_t length, uint64_t weight) {
+
+    if(weight == 1) {
+      for(uint64_t i = 0; i < length; ++i)
+        target[i] += source[i];
+    } else {
+      for(uint64_t i = 0; i < length; ++i)
+        target[i] += weight * source[i];
+    }
+  }
+
+  /*
+   * The counts of the functions of any number of profiles, merged with weights.
+   */
+  class MergedProfile {
+
+    public:
+      vector<FunctionProfile> functions;
+      vector<uint64_t> counts;
+
+      /*
+       * The following method adds the counts of a profile file times weight. Returns false if the file cannot be read or is not a profile.
+       */
+      bool add(const string &path, uint64_t weight) {
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+          perror(path.c_str());
+          return false;
+        }
+        struct stat st;
+        void *file = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(CS201ProfileHeader))
+          file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(file == MAP_FAILED) {
+          errs() << path << ": not a profile file\n";
+          return false;
+        }
+        uint64_t size = st.st_size;
+        posix_madvise(file, size, POSIX_MADV_SEQUENTIAL);
+
+        bool valid = addFile((const char*) file, size, path, weight);
+        munmap(file, size);
+        if(!valid)
+          errs() << path << ": not a profile file\n";
+        return valid;
+      }
+
+      /*
+       * The following method writes the merged counts as a profile file. Returns false on failure.
+       */
+      bool write(const string &path) const {
+
+        vector<char> data;
+        CS201ProfileHeader header = {CS201_PROFILE_MAGIC, CS201_PROFILE_VERSION, (uint32_t) functions.size(), counts.size()};
+        append(data, &header, sizeof(header));
+        for(const FunctionProfile &function : functions) {
+          CS201FunctionRecord record = {function.checksum, function.structuralHash, (uint32_t) function.name.size(), function.numBlocks,
+                                        (uint32_t) function.edges.size(), function.numPaths};
+          append(data, &record, sizeof(record));
+          append(data, function.name.data(), function.name.size());
+          if(!function.edges.empty())
+            append(data, &function.edges[0], function.edges.size() * sizeof(CS201EdgeRecord));
+          data.resize((data.size() + 7) / 8 * 8, 0);
+          if(!function.blocks.empty())
+            append(data, &function.blocks[0], function.blocks.size() * sizeof(CS201BlockRecord));
+        }
+        // The functions are in the order of their counts, which are written as they are.
+        if(!counts.empty())
+          append(data, &counts[0], counts.size() * sizeof(uint64_t));
+
+        FILE *output = fopen(path.c_str(), "wb");
+        if(!output) {
+          perror(path.c_str());
+          return false;
+        }
+        bool written = fwrite(&data[0], 1, data.size(), output) == data.size();
+        if(fclose(output) != 0 || !written) {
+          errs() << path << ": write failed\n";
+          return false;
+        }
+        return true;
+      }
+
+    private:
+      // The position of every function in the above list by name and checksum, the functions with the same ones in the order of the list.
+      multimap<pair<string, uint64_t>, size_t> functionIds;
+      // The descriptors (header included) of the last file whose functions were matched, and the runs of its counts.
+      string lastDescriptors;
+      vector<CountRun> lastRuns;
+
+      static void append(vector<char> &data, const void *bytes, size_t size) {
+        data.insert(data.end(), (const char*) bytes, (const char*) bytes + size);
+      }
+
+      /*
+       * The following method adds the counts of a mapped profile file times weight. Returns false if the file is malformed.
+       */
+      bool addFile(const char *file, uint64_t size, const string &path, uint64_t weight) {
+
+        CS201ProfileHeader header;
+        memcpy(&header, file, sizeof(header));
+        if(header.magic != CS201_PROFILE_MAGIC || header.version != CS201_PROFILE_VERSION)
+          return false;
+
+        // A file with the descriptors of the previous one has the same runs, and it is the right size if the counts follow the descriptors.
+        uint64_t descriptorsSize = lastDescriptors.size();
+        bool sameDescriptors = !lastDescriptors.empty() && size >= descriptorsSize && (size - descriptorsSize) / sizeof(uint64_t) == header.numCounts &&
+          memcmp(file, lastDescriptors.data(), descriptorsSize) == 0;
+        if(!sameDescriptors) {
+          vector<CountRun> runs;
+          if(!matchFunctions(file, size, header, path, descriptorsSize, runs))
+            return false;
+          lastDescriptors.assign(file, descriptorsSize);
+          lastRuns.swap(runs);
+        }
+
+        const uint64_t *fileCounts = (const uint64_t*) (file + descriptorsSize);
+        for(const CountRun &run : lastRuns)
+          addCounts(&counts[run.target], fileCounts + run.source, run.length, weight);
+        return true;
+      }
+
+      /*
+       * The following method matches the functions of a profile file with the merged ones, adding the functions which are new, and computes
+       * the runs of its counts. Returns false if the file is malformed.
+       */
+      bool matchFunctions(const char *file, uint64_t size, const CS201ProfileHeader &header, const string &path, uint64_t &descriptorsSize,
+                          vector<CountRun> &runs) {
+
+        uint64_t position = sizeof(header);
+        uint64_t nextCount = 0;
+        map<pair<string, uint64_t>, unsigned> occurrences;
+        for(uint32_t f = 0; f < header.numFunctions; ++f) {
+          CS201FunctionRecord record;
+          if(position + sizeof(record) > size)
+            return false;
+          memcpy(&record, file + position, sizeof(record));
+          position += sizeof(record);
+          uint64_t recordSize = record.nameLength + (uint64_t) record.numEdges * sizeof(CS201EdgeRecord);
+          if(position + recordSize > size)
+            return false;
+
+          FunctionProfile function;
+          function.name.assign(file + position, record.nameLength);
+          function.checksum = record.checksum;
+          function.structuralHash = record.structuralHash;
+          function.numBlocks = record.numBlocks;
+          function.numPaths = record.numPaths;
+          function.edges.resize(record.numEdges);
+          if(record.numEdges > 0)
+            memcpy(&function.edges[0], file + position + record.nameLength, record.numEdges * sizeof(CS201EdgeRecord));
+          position += recordSize + (8 - record.nameLength % 8) % 8;
+          if(position + (uint64_t) record.numBlocks * sizeof(CS201BlockRecord) > size)
+            return false;
+          function.blocks.resize(record.numBlocks);
+          if(record.numBlocks > 0)
+            memcpy(&function.blocks[0], file + position, record.numBlocks * sizeof(CS201BlockRecord));
+          position += record.numBlocks * sizeof(CS201BlockRecord);
+
+          uint64_t source = nextCount;
+          nextCount += function.numCounts();
+          // The counts are checked before any is allocated, as a corrupt record can claim billions of them.
+          if(nextCount > header.numCounts || nextCount > (size - position) / sizeof(uint64_t))
+            return false;
+          // The n-th function of the file with a name and checksum is merged with the n-th merged function with them.
+          pair<string, uint64_t> key(function.name, function.checksum);
+          auto range = functionIds.equal_range(key);
+          auto it = range.first;
+          for(unsigned n = occurrences[key]++; n > 0 && it != range.second; --n)
+            ++it;
+          if(it == range.second) {
+            function.firstCount = counts.size();
+            counts.resize(counts.size() + function.numCounts(), 0);
+            it = functionIds.insert(make_pair(key, functions.size()));
+            functions.push_back(function);
+          } else if(!functions[it->second].sameCFG(function)) {
+            errs() << "Warning: " << path << ": the CFG of " << function.name << " differs from the one of the merged profile, skipped\n";
+            continue;
+          }
+
+          uint64_t target = functions[it->second].firstCount;
+          if(!runs.empty() && runs.back().source + runs.back().length == source && runs.back().target + runs.back().length == target)
+            runs.back().length += function.numCounts();
+          else if(function.numCounts() > 0)
+            runs.push_back({source, target, function.numCounts()});
+        }
+
+        if(nextCount != header.numCounts || position > size || (size - position) / sizeof(uint64_t) != header.numCounts)
+          return false;
+        descriptorsSize = position;
+        return true;
+      }
+  };
+
+  /*
+   * The following method adds the weighted and unweighted inputs to a merged profile. Returns false if an input cannot be read.
+   */
+  bool mergeInputs(MergedProfile &profile, const vector<string> &inputs, const vector<string> &weightedInputs) {
+
+    for(const string &input : weightedInputs) {
+      size_t comma = input.find(',');
+      char *end = NULL;
+      unsigned long long weight = comma == string::npos ? 0 : strtoull(input.c_str(), &end, 10);
+      if(weight == 0 || end != input.c_str() + comma) {
+        errs() << "error: " << input << ": expected <weight>,<file> with a positive weight\n";
+        return false;
+      }
+      if(!profile.add(input.substr(comma + 1), weight))
+        return false;
+    }
+    for(const string &input : inputs)
+      if(!profile.add(input, 1))
+        return false;
+    return true;
+  }
+
+  /*
+   * The following method returns a percentage of a total, as printed by the reports.
+   */
+  string percent(uint64_t count, uint64_t total) {
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.2f%%", total == 0 ? 0.0 : 100.0 * count / total);
+    return buffer;
+  }
+
+  /*
+   * The following method returns the change from an old to a new count, as printed by diff.
+   */
+  string change(uint64_t oldCount, uint64_t newCount) {
+
+    char buffer[64];
+    int64_t difference = (int64_t) (newCount - oldCount);
+    if(oldCount == 0)
+      snprintf(buffer, sizeof(buffer), "%+lld", (long long) difference);
+    else
+      snprintf(buffer, sizeof(buffer), "%+lld, %+.2f%%", (long long) difference, 100.0 * difference / oldCount);
+    return buffer;
+  }
+
+  /*
+   * The following method computes the immediate dominators of the blocks of a function from its edges, block 0 being the entry, with the
+   * iterative algorithm of Cooper, Harvey and Kennedy. The blocks which cannot be reached have no dominator (-1).
+   */
+  vector<int> computeDominators(const FunctionProfile &function) {
+
+    vector<vector<uint32_t>> successors(function.numBlocks), predecessors(function.numBlocks);
+    for(const CS201EdgeRecord &edge : function.edges) {
+      if(edge.src >= function.numBlocks || edge.dst >= function.numBlocks)
+        continue;
+      successors[edge.src].push_back(edge.dst);
+      predecessors[edge.dst].push_back(edge.src);
+    }
+
+    // Post order numbers from an iterative depth first search.
+    vector<int> postOrder(function.numBlocks, -1);
+    vector<uint32_t> order;
+    vector<pair<uint32_t, size_t>> stack;
+    vector<bool> visited(function.numBlocks, false);
+    if(function.numBlocks > 0) {
+      stack.push_back(make_pair(0u, (size_t) 0));
+      visited[0] = true;
+    }
+    while(!stack.empty()) {
+      pair<uint32_t, size_t> &top = stack.back();
+      if(top.second < successors[top.first].size()) {
+        uint32_t next = successors[top.first][top.second++];
+        if(!visited[next]) {
+          visited[next] = true;
+          stack.push_back(make_pair(next, (size_t) 0));
+        }
+        continue;
+      }
+      postOrder[top.first] = order.size();
+      order.push_back(top.first);
+      stack.pop_back();
+    }
+
+    vector<int> dominators(function.numBlocks, -1);
+    if(function.numBlocks == 0)
+      return dominators;
+    dominators[0] = 0;
+    bool changed = true;
+    while(changed) {
+      changed = false;
+      for(size_t i = order.size(); i-- > 0;) {
+        uint32_t block = order[i];
+        if(block == 0)
+          continue;
+        int dominator = -1;
+        for(uint32_t predecessor : predecessors[block]) {
+          if(dominators[predecessor] < 0)
+            continue;
+          if(dominator < 0) {
+            dominator = predecessor;
+            continue;
+          }
+          int a = predecessor, b = dominator;
+          while(a != b) {
+            while(postOrder[a] < postOrder[b])
+              a = dominators[a];
+            while(postOrder[b] < postOrder[a])
+              b = dominators[b];
+          }
+          dominator = a;
+        }
+        if(dominator != dominators[block]) {
+          dominators[block] = dominator;
+          changed = true;
+        }
+      }
+    }
+    return dominators;
+  }
+
+  // A natural loop of a report: its function, header and counts.
+  struct LoopReport {
+    const FunctionProfile *function;
+    uint32_t header;
+    uint64_t entries;
+    uint64_t iterations;
+    // The executions of the blocks of the loop, nested loops included.
+    uint64_t blockExecutions;
+  };
+
+  /*
+   * The following method returns the natural loops of a function with their counts, the back edges of a header being merged into one loop as in
+   * the LOOP PROFILING section: the entries of a loop are the counts of the edges into its header from outside, and its iterations the count of
+   * its header.
+   */
+  void findLoops(const FunctionProfile &function, const uint64_t *counts, vector<LoopReport> &loops) {
+
+    vector<int> dominators = computeDominators(function);
+    auto dominates = [&](uint32_t a, uint32_t b) {
+      int block = b;
+      while(block >= 0) {
+        if((uint32_t) block == a)
+          return true;
+        if(block == 0)
+          return false;
+        block = dominators[block];
+      }
+      return false;
+    };
+
+    vector<vector<uint32_t>> predecessors(function.numBlocks);
+    map<uint32_t, vector<uint32_t>> latches;
+    for(const CS201EdgeRecord &edge : function.edges) {
+      if(edge.src >= function.numBlocks || edge.dst >= function.numBlocks)
+        continue;
+      predecessors[edge.dst].push_back(edge.src);
+      if(dominators[edge.src] >= 0 && dominates(edge.dst, edge.src))
+        latches[edge.dst].push_back(edge.src);
+    }
+
+    for(auto &header : latches) {
+      LoopReport loop = {&function, header.first, 0, counts[header.first], 0};
+      for(size_t e = 0; e < function.edges.size(); ++e)
+        if(function.edges[e].dst == header.first && function.edges[e].src < function.numBlocks && !dominates(header.first, function.edges[e].src))
+          loop.entries += counts[function.numBlocks + e];
+
+      // The blocks of the loop are the ones which reach a latch without going through the header.
+      vector<bool> inLoop(function.numBlocks, false);
+      inLoop[header.first] = true;
+      vector<uint32_t> worklist = header.second;
+      while(!worklist.empty()) {
+        uint32_t block = worklist.back();
+        worklist.pop_back();
+        if(inLoop[block])
+          continue;
+        inLoop[block] = true;
+        for(uint32_t predecessor : predecessors[block])
+          if(!inLoop[predecessor] && dominators[predecessor] >= 0)
+            worklist.push_back(predecessor);
+      }
+      for(uint32_t b = 0; b < function.numBlocks; ++b)
+        if(inLoop[b])
+          loop.blockExecutions += counts[b];
+      loops.push_back(loop);
+    }
+  }
+
+  /*
+   * The following method keeps the top elements of a list, in decreasing order of key.
+   */
+  template<typename T, typename Key>
+  void keepTop(vector<T> &list, size_t top, Key key) {
+
+    auto greater = [&](const T &a, const T &b) { return key(a) > key(b); };
+    if(list.size() > top) {
+      nth_element(list.begin(), list.begin() + top, list.end(), greater);
+      list.resize(top);
+    }
+    stable_sort(list.begin(), list.end(), greater);
+  }
+
+  /*
+   * The following method prints the hot functions, edges and loops of a merged profile.
+   */
+  void printReport(const MergedProfile &profile, size_t top) {
+
+    // The hot functions by their block executions, which are the best measure of their work the profile has.
+    vector<pair<const FunctionProfile*, uint64_t>> functions;
+    uint64_t totalBlocks = 0;
+    vector<pair<const FunctionProfile*, uint32_t>> edges;
+    uint64_t totalEdges = 0;
+    vector<LoopReport> loops;
+    for(const FunctionProfile &function : profile.functions) {
+      const uint64_t *counts = profile.counts.data() + function.firstCount;
+      uint64_t blocks = 0;
+      for(uint32_t b = 0; b < function.numBlocks; ++b)
+        blocks += counts[b];
+      totalBlocks += blocks;
+      functions.push_back(make_pair(&function, blocks));
+      for(uint32_t e = 0; e < function.edges.size(); ++e) {
+        totalEdges += counts[function.numBlocks + e];
+        if(counts[function.numBlocks + e] > 0)
+          edges.push_back(make_pair(&function, e));
+      }
+      findLoops(function, counts, loops);
+    }
+    auto count = [&](const FunctionProfile *function, uint64_t index) { return profile.counts[function->firstCount + index]; };
+
+    keepTop(functions, top, [](const pair<const FunctionProfile*, uint64_t> &function) { return function.second; });
+    outs() << "HOT FUNCTIONS (block executions):\n";
+    for(auto &function : functions) {
+      if(function.second == 0)
+        break;
+      outs() << function.first->name << ": " << function.second << " (" << percent(function.second, totalBlocks) << "), entries "
+             << (function.first->numBlocks > 0 ? count(function.first, 0) : 0) << "\n";
+    }
+
+    keepTop(edges, top, [&](const pair<const FunctionProfile*, uint32_t> &edge) { return count(edge.first, edge.first->numBlocks + edge.second); });
+    outs() << "\nHOT EDGES:\n";
+    for(auto &edge : edges) {
+      const CS201EdgeRecord &record = edge.first->edges[edge.second];
+      uint64_t edgeCount = count(edge.first, edge.first->numBlocks + edge.second);
+      outs() << edge.first->name << ": b" << record.src << " -> b" << record.dst << ": " << edgeCount << " (" << percent(edgeCount, totalEdges)
+             << ")\n";
+    }
+
+    keepTop(loops, top, [](const LoopReport &loop) { return loop.blockExecutions; });
+    outs() << "\nHOT LOOPS (block executions):\n";
+    for(const LoopReport &loop : loops) {
+      if(loop.blockExecutions == 0)
+        break;
+      outs() << loop.function->name << ": b" << loop.header << ": " << loop.blockExecutions << " (" << percent(loop.blockExecutions, totalBlocks)
+             << "), entries " << loop.entries << ", iterations " << loop.iterations << "\n";
+    }
+    outs().flush();
+  }
+
+  /*
+   * The following method prints the counts of a function which differ between two profiles. Returns true if any differs.
+   */
+  bool printFunctionDiff(const FunctionProfile &function, const uint64_t *oldCounts, const uint64_t *newCounts) {
+
+    bool header = false;
+    auto print = [&](uint64_t index) {
+      if(oldCounts[index] == newCounts[index])
+        return;
+      if(!header) {
+        outs() << "\n" << function.name << ":\n";
+        header = true;
+      }
+      if(index < function.numBlocks)
+        outs() << "b" << index;
+      else if(index < function.numBlocks + function.edges.size())
+        outs() << "b" << function.edges[index - function.numBlocks].src << " -> b" << function.edges[index - function.numBlocks].dst;
+      else
+        outs() << "path " << index - function.numBlocks - function.edges.size();
+      outs() << ": " << oldCounts[index] << " -> " << newCounts[index] << " (" << change(oldCounts[index], newCounts[index]) << ")\n";
+    };
+    for(uint64_t i = 0; i < function.numCounts(); ++i)
+      print(i);
+    return header;
+  }
+
+  /*
+   * The following method prints the counts of a function whose CFG changed between two profiles (or whose blocks only moved, when its structural
+   * hash is the same), its blocks being matched by their identities (see matchCS201Blocks). The blocks and edges are printed with their ids in the
+   * new profile, followed by the ones in the old profile when they differ, and the paths are not compared.
+   */
+  void printChangedFunctionDiff(const FunctionProfile &oldFunction, const FunctionProfile &newFunction, const uint64_t *oldCounts,
+                                const uint64_t *newCounts) {
+
+    vector<int> match = matchCS201Blocks(newFunction.blocks, oldFunction.blocks);
+    unsigned numMatched = match.size() - count(match.begin(), match.end(), -1);
+    bool moved = oldFunction.structuralHash == newFunction.structuralHash;
+    outs() << "\n" << newFunction.name << (moved ? ": the blocks moved, " : ": the CFG changed, ") << numMatched << " of " << newFunction.numBlocks
+           << " blocks matched\n";
+
+    auto print = [&](uint64_t oldCount, uint64_t newCount) {
+      outs() << ": " << oldCount << " -> " << newCount << " (" << change(oldCount, newCount) << ")\n";
+    };
+    string unmatched;
+    for(uint32_t b = 0; b < newFunction.numBlocks; ++b) {
+      if(match[b] < 0) {
+        unmatched += " b" + to_string(b);
+      } else if(oldCounts[match[b]] != newCounts[b]) {
+        outs() << "b" << b;
+        if((uint32_t) match[b] != b)
+          outs() << " (b" << match[b] << ")";
+        print(oldCounts[match[b]], newCounts[b]);
+      }
+    }
+    map<pair<uint32_t, uint32_t>, uint32_t> oldEdges;
+    for(uint32_t e = 0; e < oldFunction.edges.size(); ++e)
+      oldEdges[make_pair(oldFunction.edges[e].src, oldFunction.edges[e].dst)] = e;
+    for(uint32_t e = 0; e < newFunction.edges.size(); ++e) {
+      const CS201EdgeRecord &edge = newFunction.edges[e];
+      if(edge.src >= match.size() || edge.dst >= match.size() || match[edge.src] < 0 || match[edge.dst] < 0)
+        continue;
+      auto it = oldEdges.find(make_pair((uint32_t) match[edge.src], (uint32_t) match[edge.dst]));
+      if(it == oldEdges.end())
+        continue;
+      uint64_t oldCount = oldCounts[oldFunction.numBlocks + it->second], newCount = newCounts[newFunction.numBlocks + e];
+      if(oldCount == newCount)
+        continue;
+      outs() << "b" << edge.src << " -> b" << edge.dst;
+      if((uint32_t) match[edge.src] != edge.src || (uint32_t) match[edge.dst] != edge.dst)
+        outs() << " (b" << match[edge.src] << " -> b" << match[edge.dst] << ")";
+      print(oldCount, newCount);
+    }
+    if(!unmatched.empty())
+      outs() << "not in the old profile:" << unmatched << "\n";
+  }
+
+  /*
+   * The following method prints the differences between two profiles: the functions in only one of them, and the block, edge and path counts
+   * which changed. Returns the number of functions which differ.
+   */
+  unsigned printDiff(const MergedProfile &oldProfile, const MergedProfile &newProfile) {
+
+    // The functions are paired by name and checksum like merge does, and the remaining ones by name, as functions whose CFG changed.
+    const vector<FunctionProfile> &oldFunctions = oldProfile.functions, &newFunctions = newProfile.functions;
+    vector<int> newFunction(oldFunctions.size(), -1);
+    vector<bool> paired(newFunctions.size(), false);
+    multimap<string, size_t> newIds;
+    for(size_t g = 0; g < newFunctions.size(); ++g)
+      newIds.insert(make_pair(newFunctions[g].name, g));
+    for(int sameChecksum = 1; sameChecksum >= 0; --sameChecksum) {
+      for(size_t f = 0; f < oldFunctions.size(); ++f) {
+        auto range = newIds.equal_range(oldFunctions[f].name);
+        for(auto it = range.first; it != range.second && newFunction[f] < 0; ++it) {
+          if(!paired[it->second] && (!sameChecksum || newFunctions[it->second].checksum == oldFunctions[f].checksum)) {
+            newFunction[f] = it->second;
+            paired[it->second] = true;
+          }
+        }
+      }
+    }
+
+    unsigned different = 0;
+    for(size_t f = 0; f < oldFunctions.size(); ++f) {
+      const FunctionProfile &function = oldFunctions[f];
+      if(newFunction[f] < 0) {
+        outs() << "\n" << function.name << ": only in the old profile\n";
+        different++;
+        continue;
+      }
+      const FunctionProfile &other = newFunctions[newFunction[f]];
+      if(!function.sameCFG(other)) {
+        printChangedFunctionDiff(function, other, oldProfile.counts.data() + function.firstCount, newProfile.counts.data() + other.firstCount);
+        different++;
+      } else if(printFunctionDiff(function, oldProfile.counts.data() + function.firstCount, newProfile.counts.data() + other.firstCount)) {
+        different++;
+      }
+    }
+    for(size_t g = 0; g < newFunctions.size(); ++g) {
+      if(!paired[g]) {
+        outs() << "\n" << newFunctions[g].name << ": only in the new profile\n";
+        different++;
+      }
+    }
+    outs().flush();
+    return different;
+  }
+
+  int mergeMain(int argc, const char **argv) {
+
+    static cl::list<string> Inputs(cl::Positional, cl::desc("<profile files>"));
+    static cl::list<string> WeightedInputs("weighted-input", cl::desc("A profile file whose counts are multiplied by <weight>"),
+                                           cl::value_desc("weight,file"));
+    static cl::opt<string> Output("o", cl::desc("Output profile file"), cl::value_desc("file"), cl::Required);
+    cl::ParseCommandLineOptions(argc, argv, "CS201 profile merger\n");
+
+    if(Inputs.empty() && WeightedInputs.empty()) {
+      errs() << "error: no input profiles\n";
+      return 1;
+    }
+    MergedProfile profile;
+    if(!mergeInputs(profile, Inputs, WeightedInputs) || !profile.write(Output))
+      return 1;
+    return 0;
+  }
+
+  int diffMain(int argc, const char **argv) {
+
+    static cl::opt<string> OldProfile(cl::Positional, cl::desc("<old profile>"), cl::Required);
+    static cl::opt<string> NewProfile(cl::Positional, cl::desc("<new profile>"), cl::Required);
+    cl::ParseCommandLineOptions(argc, argv, "CS201 profile diff\n");
+
+    MergedProfile oldProfile, newProfile;
+    if(!oldProfile.add(OldProfile, 1) || !newProfile.add(NewProfile, 1))
+      return 2;
+    return printDiff(oldProfile, newProfile) == 0 ? 0 : 1;
+  }
+
+  int reportMain(int argc, const char **argv) {
+
+    static cl::list<string> Inputs(cl::Positional, cl::desc("<profile files>"));
+    static cl::list<string> WeightedInputs("weighted-input", cl::desc("A profile file whose counts are multiplied by <weight>"),
+                                           cl::value_desc("weight,file"));
+    static cl::opt<unsigned> Top("top", cl::desc("Number of functions, edges and loops to print"), cl::value_desc("n"), cl::init(10));
+    cl::ParseCommandLineOptions(argc, argv, "CS201 hot spot report\n");
+
+    if(Inputs.empty() && WeightedInputs.empty()) {
+      errs() << "error: no input profiles\n";
+      return 1;
+    }
+    MergedProfile profile;
+    if(!mergeInputs(profile, Inputs, WeightedInputs))
+      return 1;
+    printReport(profile, Top);
+    return 0;
+  }
+}
+
+int main(int argc, const char **argv) {
+
+  if(argc > 1) {
+    int (*command)(int, const char **) = NULL;
+    if(strcmp(argv[1], "merge") == 0)
+      command = mergeMain;
+    else if(strcmp(argv[1], "diff") == 0)
+      command = diffMain;
+    else if(strcmp(argv[1], "report") == 0)
+      command = reportMain;
+    if(command) {
+      // The command is part of the program name of its options.
+      string invocation = string(argv[0]) + " " + argv[1];
+      argv[1] = invocation.c_str();
+      return command(argc - 1, argv + 1);
+    }
+  }
+  errs() << "usage: " << argv[0] << " merge|diff|report [options]\n"
+         << "  merge   merge profiles, with weights, into one profile (-o <file>)\n"
+         << "  diff    print the counts which differ between two profiles\n"
+         << "  report  print the hot functions, edges and loops of profiles\n"
+         << "Use " << argv[0] << " <command> -help for the options of a command.\n";
+  return 1;
+}